@@ -0,0 +1,492 @@
+#include "tools/mgmecs.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Benchmarks for MGMecs, each scenario matching a change it was measured for. Run without arguments for every scenario,
+ * or with the names of the scenarios to run. Times are the best of a few runs, so a noisy first run doesn't skew them
+ */
+
+namespace {
+    using namespace mgm;
+    using Ecs = MGMecs<>;
+    using Entity = Ecs::Entity;
+    using Clock = std::chrono::steady_clock;
+
+    struct Position {
+        float x = 0.0f, y = 0.0f, z = 0.0f, w = 0.0f;
+    };
+    struct Velocity {
+        float x = 1.0f, y = 1.0f, z = 1.0f, w = 0.0f;
+    };
+    struct Health {
+        float value = 100.0f;
+    };
+    struct Rare {
+        float value = 0.0f;
+    };
+    struct Excluded {
+        float value = 0.0f;
+    };
+
+    template<size_t N>
+    struct Column {
+        float v[4]{};
+    };
+
+    struct Packed16 {
+        float v[4]{};
+    };
+    struct Stable16 {
+        static constexpr bool stable_storage = true;
+        float v[4]{};
+    };
+
+    volatile float sink = 0.0f;
+
+    void consume(const float value) {
+        sink = value;
+    }
+
+    template<typename Fn>
+    double time_ms(Fn&& fn) {
+        const auto start = Clock::now();
+        fn();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    template<typename Fn>
+    double best_ms(const size_t repeats, Fn&& fn) {
+        auto best = time_ms(fn);
+        for (size_t i = 1; i < repeats; ++i)
+            best = std::min(best, time_ms(fn));
+        return best;
+    }
+
+    double ns_per(const double ms, const size_t count) {
+        return ms * 1e6 / static_cast<double>(count);
+    }
+
+    template<typename T>
+    std::vector<T> shuffled(std::vector<T> values) {
+        std::mt19937 rng{42};
+        std::shuffle(values.begin(), values.end(), rng);
+        return values;
+    }
+
+    template<typename World, typename... Ts>
+    std::vector<typename World::Entity> create_with(World& ecs, const size_t count, const Ts&... components) {
+        std::vector<typename World::Entity> res(count);
+        ecs.create(res.begin(), res.end());
+        (ecs.template emplace<Ts>(res.begin(), res.end(), components), ...);
+        return res;
+    }
+
+    // The bucket layout from before the paged sparse arrays, a locked hash map from entities to dense indices
+    struct MapBucket {
+        std::mutex mutex{};
+        std::unordered_map<Entity, size_t, Entity::Hash> sparse{};
+        std::vector<Position> components{};
+
+        void create(const Entity e) {
+            sparse.emplace(e, components.size());
+            components.emplace_back();
+        }
+        Position& get(const Entity e) {
+            std::unique_lock lock{mutex};
+            return components[sparse.at(e)];
+        }
+    };
+
+    // 200k entities accessed in shuffled order, through the paged sparse arrays and the old hash map
+    void bench_sparse() {
+        constexpr size_t count = 200'000;
+        Ecs ecs{};
+        const auto entities = create_with(ecs, count, Position{});
+        const auto order = shuffled(entities);
+
+        MapBucket old{};
+        for (const auto e : entities)
+            old.create(e);
+        const auto map_get = best_ms(5, [&] {
+            auto total = 0.0f;
+            for (const auto e : order)
+                total += old.get(e).x;
+            consume(total);
+        });
+
+        const auto get = best_ms(5, [&] {
+            auto total = 0.0f;
+            for (const auto e : order)
+                total += ecs.get<Position>(e).x;
+            consume(total);
+        });
+        const auto try_get = best_ms(5, [&] {
+            auto total = 0.0f;
+            for (const auto e : order)
+                if (const auto* p = ecs.try_get<Position>(e))
+                    total += p->x;
+            consume(total);
+        });
+        auto group = ecs.group().include<Position>();
+        const auto walk = best_ms(5, [&] {
+            auto total = 0.0f;
+            for (const auto& node : group)
+                total += node.get<Position>().x;
+            consume(total);
+        });
+
+        std::printf("sparse: %zu entities, shuffled order, ns per entity\n", count);
+        std::printf("  unordered_map index (old layout)  %8.1f\n", ns_per(map_get, count));
+        std::printf("  get<T>                            %8.1f\n", ns_per(get, count));
+        std::printf("  try_get<T>                        %8.1f\n", ns_per(try_get, count));
+        std::printf("  range-for group walk              %8.1f\n", ns_per(walk, count));
+    }
+
+    template<size_t... Ns>
+    void bench_archetype_case(const size_t count, std::index_sequence<Ns...>) {
+        Ecs buckets{};
+        std::vector<Entity> entities{};
+        entities.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto e = buckets.create();
+            (buckets.emplace<Column<Ns>>(e), ...);
+            entities.push_back(e);
+        }
+        const auto bucket_ms = best_ms(3, [&] {
+            auto total = 0.0f;
+            for (const auto e : entities) {
+                const auto ptrs = std::make_tuple(buckets.try_get<Column<Ns>>(e)...);
+                std::apply([&](const auto*... p) {
+                    if ((... && (p != nullptr)))
+                        total += (... + p->v[0]);
+                }, ptrs);
+            }
+            consume(total);
+        });
+
+        Ecs arch{};
+        for (size_t i = 0; i < count; ++i)
+            arch.create_archetype(Column<Ns>{}...);
+        const auto arch_ms = best_ms(3, [&] {
+            auto total = 0.0f;
+            arch.group().include<Column<Ns>...>().archetype_each([&](Entity, Column<Ns>&... c) { total += (... + c.v[0]); });
+            consume(total);
+        });
+
+        std::printf("  %zu comps, %7zu entities  %8.1f  %8.1f\n", sizeof...(Ns), count, ns_per(bucket_ms, count), ns_per(arch_ms, count));
+    }
+
+    // Buckets probed with try_get against archetype_each, with 2, 3 and 5 components per entity
+    void bench_archetype() {
+        std::printf("archetype: ns per entity          try_get  archetype_each\n");
+        for (const size_t count : {10'000, 100'000, 1'000'000}) {
+            bench_archetype_case(count, std::make_index_sequence<2>{});
+            bench_archetype_case(count, std::make_index_sequence<3>{});
+            bench_archetype_case(count, std::make_index_sequence<5>{});
+        }
+    }
+
+    // Group::each against Group::par_each on pools of growing size
+    void bench_par_each() {
+        constexpr size_t count = 1'000'000;
+        Ecs ecs{};
+        create_with(ecs, count, Position{}, Velocity{});
+        auto group = ecs.group().include<Position, Velocity>();
+
+        const auto update = [](Entity, Position& p, const Velocity& v) {
+            for (int i = 0; i < 8; ++i) {
+                p.x += v.x * 0.016f;
+                p.y = p.y * 0.99f + v.y * 0.016f;
+                p.z += p.x * p.y * 0.001f;
+            }
+        };
+
+        const auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+        std::printf("par_each: %zu entities, %u hardware threads, ms per pass\n", count, cores);
+        std::printf("  each                    %8.2f\n", best_ms(5, [&] { group.each(update); }));
+
+        std::vector<size_t> thread_counts{1, 2, 4, 8};
+        if (cores > 8)
+            thread_counts.push_back(cores);
+        for (const auto threads : thread_counts) {
+            MGMecsThreadPool pool{threads - 1};
+            const auto ms = best_ms(5, [&] { group.par_each(update, pool); });
+            std::printf("  par_each, %2zu threads    %8.2f\n", threads, ms);
+        }
+    }
+
+    // Owning group over <Position, Velocity, Health> at 100%, 50% and 25% populations
+    void bench_owning() {
+        constexpr size_t count = 200'000;
+
+        const auto populate = [&](Ecs& ecs, std::vector<Entity>& entities) {
+            entities.resize(count);
+            ecs.create(entities.begin(), entities.end());
+            return time_ms([&] {
+                for (size_t i = 0; i < count; ++i) {
+                    ecs.emplace<Position>(entities[i]);
+                    if (i % 2 == 0)
+                        ecs.emplace<Velocity>(entities[i]);
+                    if (i % 4 == 0)
+                        ecs.emplace<Health>(entities[i]);
+                }
+            });
+        };
+        const auto remove_half = [&](Ecs& ecs, const std::vector<Entity>& entities) {
+            return time_ms([&] {
+                for (size_t i = 0; i < count; i += 2)
+                    ecs.remove<Position>(entities[i]);
+            });
+        };
+
+        Ecs plain{};
+        std::vector<Entity> plain_entities{};
+        const auto plain_emplace = populate(plain, plain_entities);
+        const auto plain_each = best_ms(5, [&] {
+            auto total = 0.0f;
+            plain.group().include<Position, Velocity, Health>().each([&](Entity, Position& p, Velocity& v, Health& h) { total += p.x + v.x + h.value; });
+            consume(total);
+        });
+        const auto plain_remove = remove_half(plain, plain_entities);
+
+        Ecs owned{};
+        auto& owning = owned.owning_group<Position, Velocity, Health>();
+        std::vector<Entity> owned_entities{};
+        const auto owned_emplace = populate(owned, owned_entities);
+        const auto group_each = best_ms(5, [&] {
+            auto total = 0.0f;
+            owned.group().include<Position, Velocity, Health>().each([&](Entity, Position& p, Velocity& v, Health& h) { total += p.x + v.x + h.value; });
+            consume(total);
+        });
+        const auto owning_each = best_ms(5, [&] {
+            auto total = 0.0f;
+            owning.each([&](Entity, Position& p, Velocity& v, Health& h) { total += p.x + v.x + h.value; });
+            consume(total);
+        });
+        const auto owned_remove = remove_half(owned, owned_entities);
+
+        std::printf("owning group: %zu entities, ms                 no group     owned\n", count);
+        std::printf("  emplace (350k components)                %8.2f  %8.2f\n", plain_emplace, owned_emplace);
+        std::printf("  remove Position (100k)                   %8.2f  %8.2f\n", plain_remove, owned_remove);
+        std::printf("  Group::each <Position, Velocity, Health> %8.2f  %8.2f\n", plain_each, group_each);
+        std::printf("  OwningGroup::each                                  %8.2f\n", owning_each);
+    }
+
+    // Bulk passes driven from the smallest included bucket, whichever order the includes are listed in
+    void bench_driver() {
+        constexpr size_t count = 500'000;
+        Ecs ecs{};
+        const auto entities = create_with(ecs, count, Position{});
+        for (size_t i = 0; i < count; ++i) {
+            if (i % 100 == 0)
+                ecs.emplace<Rare>(entities[i]);
+            if (i % 2 == 0)
+                ecs.emplace<Excluded>(entities[i]);
+        }
+
+        const auto common_rare = best_ms(5, [&] {
+            auto total = 0.0f;
+            ecs.group().include<Position, Rare>().each([&](Entity, Position& p, Rare& r) { total += p.x + r.value; });
+            consume(total);
+        });
+        const auto rare_common = best_ms(5, [&] {
+            auto total = 0.0f;
+            ecs.group().include<Rare, Position>().each([&](Entity, Rare& r, Position& p) { total += p.x + r.value; });
+            consume(total);
+        });
+        const auto with_exclude = best_ms(5, [&] {
+            auto total = 0.0f;
+            ecs.group().include<Position, Rare>().exclude<Excluded>().each([&](Entity, Position& p, Rare& r) { total += p.x + r.value; });
+            consume(total);
+        });
+
+        std::printf("driver: %zu entities, Rare on 1%%, Excluded on 50%%, ms per pass\n", count);
+        std::printf("  include<Position, Rare>                    %8.3f\n", common_rare);
+        std::printf("  include<Rare, Position>                    %8.3f\n", rare_common);
+        std::printf("  include<Position, Rare> exclude<Excluded>  %8.3f\n", with_exclude);
+    }
+
+    // Render threads reading entities under shared locks while an update thread writes them under exclusive ones
+    void bench_locks() {
+        constexpr size_t count = 4096;
+        constexpr size_t frames = 200;
+        Ecs ecs{};
+        const auto entities = create_with(ecs, count, Position{});
+
+        const auto run = [&](const size_t readers) {
+            return time_ms([&] {
+                std::vector<std::thread> threads{};
+                for (size_t r = 0; r < readers; ++r)
+                    threads.emplace_back([&] {
+                        auto total = 0.0f;
+                        for (size_t f = 0; f < frames; ++f)
+                            for (const auto e : entities) {
+                                ecs.wait_and_lock_shared(e);
+                                total += std::as_const(ecs).get<Position>(e).x;
+                                ecs.unlock_shared(e);
+                            }
+                        consume(total);
+                    });
+                threads.emplace_back([&] {
+                    for (size_t f = 0; f < frames; ++f)
+                        for (const auto e : entities) {
+                            ecs.wait_and_lock(e);
+                            ecs.get<Position>(e).x += 1.0f;
+                            ecs.unlock(e);
+                        }
+                });
+                for (auto& thread : threads)
+                    thread.join();
+            });
+        };
+
+        std::printf("locks: %zu entities, %zu frames per thread, ms\n", count, frames);
+        std::printf("  1 render + 1 update     %8.1f\n", run(1));
+        std::printf("  3 render + 1 update     %8.1f\n", run(3));
+    }
+
+    template<typename T>
+    void bench_storage_case(double (&results)[4]) {
+        constexpr size_t count = 200'000;
+        Ecs ecs{};
+        std::vector<Entity> entities(count);
+        ecs.create(entities.begin(), entities.end());
+        results[0] = time_ms([&] {
+            for (const auto e : entities)
+                ecs.emplace<T>(e);
+        });
+
+        const auto order = shuffled(entities);
+        results[1] = time_ms([&] {
+            for (const auto e : order) {
+                ecs.remove<T>(e);
+                ecs.emplace<T>(e);
+            }
+        });
+
+        for (size_t i = 0; i < count; i += 4)
+            ecs.remove<T>(order[i]);
+        auto group = ecs.group().include<T>();
+        results[2] = best_ms(5, [&] {
+            auto total = 0.0f;
+            group.each([&](Entity, T& c) { total += c.v[0]; });
+            consume(total);
+        });
+        results[3] = best_ms(3, [&] {
+            auto total = 0.0f;
+            for (const auto& node : group)
+                total += node.template get<T>().v[0];
+            consume(total);
+        });
+    }
+
+    // Packed buckets against stable storage, for 16 byte components
+    void bench_stable() {
+        double packed[4]{};
+        double stable[4]{};
+        bench_storage_case<Packed16>(packed);
+        bench_storage_case<Stable16>(stable);
+
+        std::printf("stable storage: 200000 components of 16 bytes, ms    packed    stable\n");
+        std::printf("  emplace all                                  %8.2f  %8.2f\n", packed[0], stable[0]);
+        std::printf("  200k random remove+emplace                   %8.2f  %8.2f\n", packed[1], stable[1]);
+        std::printf("  Group::each after 25%% removed                %8.2f  %8.2f\n", packed[2], stable[2]);
+        std::printf("  range-for iterator                           %8.2f  %8.2f\n", packed[3], stable[3]);
+    }
+
+    template<typename World>
+    double bench_policy_case(const size_t count) {
+        World ecs{};
+        const auto order = shuffled(create_with(ecs, count, Position{}));
+        return best_ms(5, [&] {
+            auto total = 0.0f;
+            for (const auto e : order)
+                total += ecs.template get<Position>(e).x;
+            consume(total);
+        });
+    }
+
+    // Random order get<T> in multi threaded and single threaded worlds
+    void bench_policy() {
+        constexpr size_t count = 200'000;
+        const auto multi = bench_policy_case<MGMecs<uint32_t, MGMecsMultiThreaded>>(count);
+        const auto single = bench_policy_case<MGMecs<uint32_t, MGMecsSingleThreaded>>(count);
+
+        std::printf("policy: %zu entities, shuffled get<T>, ns per access\n", count);
+        std::printf("  MGMecsMultiThreaded     %8.1f\n", ns_per(multi, count));
+        std::printf("  MGMecsSingleThreaded    %8.1f\n", ns_per(single, count));
+    }
+
+    // Snapshot and restore of a small world with an owning group
+    void bench_snapshot() {
+        constexpr size_t count = 10'000;
+        Ecs ecs{};
+        ecs.owning_group<Position, Velocity>();
+        const auto entities = create_with(ecs, count, Position{}, Velocity{});
+        for (size_t i = 0; i < count; i += 2)
+            ecs.emplace<Health>(entities[i]);
+
+        Ecs::Snapshot snapshot{};
+        const auto save = best_ms(5, [&] { snapshot = ecs.snapshot(); });
+        for (size_t i = 0; i < count; i += 3)
+            ecs.destroy(entities[i]);
+        const auto restore = best_ms(5, [&] { ecs.restore(snapshot); });
+
+        std::printf("snapshot: %zu entities, %zu bytes, ms\n", count, snapshot.bytes());
+        std::printf("  snapshot                %8.3f\n", save);
+        std::printf("  restore                 %8.3f\n", restore);
+    }
+
+    struct Scenario {
+        std::string_view name;
+        void (*run)();
+    };
+
+    constexpr Scenario scenarios[] = {
+        {"sparse", bench_sparse},
+        {"archetype", bench_archetype},
+        {"par_each", bench_par_each},
+        {"owning", bench_owning},
+        {"driver", bench_driver},
+        {"locks", bench_locks},
+        {"stable", bench_stable},
+        {"policy", bench_policy},
+        {"snapshot", bench_snapshot},
+    };
+} // namespace
+
+
+int main(int argc, char** argv) {
+    if (argc <= 1) {
+        for (const auto& scenario : scenarios) {
+            scenario.run();
+            std::printf("\n");
+        }
+        return 0;
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view name{argv[i]};
+        const auto it = std::find_if(std::begin(scenarios), std::end(scenarios), [&](const Scenario& s) { return s.name == name; });
+        if (it == std::end(scenarios)) {
+            std::fprintf(stderr, "Unknown scenario: %s\n", argv[i]);
+            return 1;
+        }
+        it->run();
+        std::printf("\n");
+    }
+    return 0;
+}
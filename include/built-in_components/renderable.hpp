@@ -38,8 +38,15 @@ namespace mgm {
         return res;
     }
 
+    // Vectors are written into binary scenes byte for byte, as long as they have no padding
+    template<size_t S, typename T>
+    struct binary_scene::raw_encodable<vec<S, T>> : std::bool_constant<sizeof(vec<S, T>) == S * sizeof(T)> {};
+
 
     struct Transform {
+        // Written into binary scenes byte for byte
+        static constexpr bool raw_encodable = true;
+
         vec3f pos{};
         vec3f scale{1.0f};
         quatf rot{};
@@ -47,7 +54,7 @@ namespace mgm {
         Transform() = default;
 
         Transform(const SerializedData<Transform>& json);
-        operator SerializedData<Transform>();
+        operator SerializedData<Transform>() const;
 
         mat4f as_matrix() const;
 
@@ -56,6 +63,7 @@ namespace mgm {
         Transform operator*(const Transform& other) const;
         Transform& operator*=(const Transform& other);
     };
+    static_assert(sizeof(Transform) == sizeof(vec3f) * 2 + sizeof(quatf), "Transform is written byte for byte, so it can't have padding");
 
 
     class Shader : public Resource {
@@ -4,67 +4,73 @@
 #include "json.hpp"
 #include "systems.hpp"
 #include "tools/mgmecs.hpp"
+#include <algorithm>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
 #include <mutex>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 
 namespace mgm {
     struct HierarchyNode {
+        // Once the node is part of the ecs and has a parent, change it through rename(), which keeps the parent's
+        // children_by_name up to date
         std::string name = "Node";
         mgm::MGMecs<>::Entity parent{};
-        mgm::MGMecs<>::Entity child{};
-        mgm::MGMecs<>::Entity prev{};
-        mgm::MGMecs<>::Entity next{};
 
-        mgm::MGMecs<>::Entity::Type num_children = 0;
+        // Children in order, so indexing and walking them is an array access instead of chasing siblings through the ecs
+        std::vector<mgm::MGMecs<>::Entity> child_entities{};
+
+        // The children by their names, kept up to date by every insertion, removal and rename (names don't have to be
+        // unique, so this can hold several children for one name)
+        std::unordered_multimap<std::string, mgm::MGMecs<>::Entity> children_by_name{};
+
+        // Position of this node in its parent's child_entities, kept up to date by every insertion and removal (which only
+        // holds the parent's lock, find_child_index checks the position before trusting it)
+        size_t index_in_parent = 0;
 
         HierarchyNode(mgm::MGMecs<>::Entity parent_node) : parent{parent_node} {}
+        HierarchyNode(mgm::MGMecs<>::Entity parent_node, std::string node_name) : name{std::move(node_name)}, parent{parent_node} {}
 
         void on_construct(mgm::MGMecs<>* ecs, const mgm::MGMecs<>::Entity self);
 
         void on_destroy(mgm::MGMecs<>* ecs, const mgm::MGMecs<>::Entity self);
 
-        struct Iterator {
-            using iterator_category = std::forward_iterator_tag;
-            using value_type = mgm::MGMecs<>::Entity;
-            using difference_type = mgm::MGMecs<>::Entity::Type;
-            using pointer = mgm::MGMecs<>::Entity*;
-            using reference = mgm::MGMecs<>::Entity&;
-
-            MGMecs<>::Entity current;
-
-            Iterator& operator++();
-            Iterator operator++(int);
+        using Iterator = std::vector<mgm::MGMecs<>::Entity>::const_iterator;
 
-            Iterator& operator--();
-            Iterator operator--(int);
+        Iterator begin() const { return child_entities.begin(); }
+        Iterator end() const { return child_entities.end(); }
 
-            Iterator operator+(size_t i) const;
-            Iterator& operator+=(size_t i);
-
-            Iterator operator-(size_t i) const;
-            Iterator& operator-=(size_t i);
+        /**
+         * @brief Get a copy of the children of this node, safe to iterate while the hierarchy is being edited
+         */
+        std::vector<MGMecs<>::Entity> children() const { return child_entities; }
 
-            bool operator==(const Iterator& other) const { return current == other.current; }
-            bool operator!=(const Iterator& other) const { return current != other.current; }
+        size_t num_children() const { return child_entities.size(); }
 
-            mgm::MGMecs<>::Entity& operator*() { return current; }
-            const mgm::MGMecs<>::Entity& operator*() const { return current; }
-        };
+        bool has_children() const { return !child_entities.empty(); }
 
-        Iterator begin() const { return Iterator{child}; }
-        Iterator end() const { return Iterator{mgm::MGMecs<>::null}; }
+        /**
+         * @brief Get the first child of this node, or null if it has none
+         */
+        MGMecs<>::Entity first_child() const { return child_entities.empty() ? mgm::MGMecs<>::null : child_entities.front(); }
 
         /**
-         * @brief Get a vector of entities representing the children of this node
+         * @brief Get the sibling right after this node in its parent, or null if this is the last child (or a root)
          */
-        std::vector<MGMecs<>::Entity> children() const { return {begin(), end()}; }
+        MGMecs<>::Entity next_sibling() const;
 
-        bool has_children() const { return child != mgm::MGMecs<>::null; }
+        /**
+         * @brief Get the sibling right before this node in its parent, or null if this is the first child (or a root)
+         */
+        MGMecs<>::Entity prev_sibling() const;
 
         /**
          * @brief Check if this node is the root of some hierarchy
@@ -74,13 +80,21 @@ namespace mgm {
         bool is_root() const { return parent == mgm::MGMecs<>::null; }
 
         /**
-         * @brief Remove this node from its parent's children and make it the first child of new_parent
+         * @brief Remove this node from its parent's children and insert it into the children of new_parent, with both parents
+         * locked while their children change
          *
          * @param new_parent The entity to make the parent of this node
          * @param index The index in the children of new_parent to make this node
          */
         void reparent(mgm::MGMecs<>::Entity new_parent, size_t index = 0);
 
+        /**
+         * @brief Change the name of this node, with its parent locked while its index of names changes
+         *
+         * @param new_name The new name of the node
+         */
+        void rename(const std::string& new_name);
+
         /**
          * @brief Get the index of the child in the children of this node
          *
@@ -104,6 +118,16 @@ namespace mgm {
          * @return MGMecs<>::Entity The entity with the name name, or null if no such entity exists
          */
         MGMecs<>::Entity get_child_by_name(const std::string& child_name) const;
+
+        /**
+         * @brief Get the descendant of this node at a path of names separated by slashes (like "level/props/crate_17"),
+         * looking up one child by name for each name in the path
+         *
+         * @param path The names of the nodes leading to the descendant, starting with a child of this node. An empty path
+         * refers to this node itself, a path with an empty name in it (from a leading, trailing or doubled slash) to no node
+         * @return MGMecs<>::Entity The descendant, or null if no node is at that path
+         */
+        MGMecs<>::Entity find_by_path(const std::string& path) const;
     };
 
 
@@ -187,6 +211,429 @@ namespace mgm {
     template<typename T> inline constexpr bool has_external_deserialize_v = has_external_deserialize<T>::value;
 
 
+    template<typename, typename = void> struct has_serialize_binary : std::false_type {};
+
+    template<typename T>
+    struct has_serialize_binary<T, std::void_t<decltype(std::declval<const T&>().serialize_binary(std::declval<std::vector<uint8_t>&>()))>>
+        : std::is_same<void, decltype(std::declval<const T&>().serialize_binary(std::declval<std::vector<uint8_t>&>()))> {};
+
+    template<typename T> inline constexpr bool has_serialize_binary_v = has_serialize_binary<T>::value;
+
+
+    template<typename, typename = void> struct has_external_serialize_binary : std::false_type {};
+
+    template<typename T>
+    struct has_external_serialize_binary<T, std::void_t<decltype(serialize_binary(std::declval<const T&>(), std::declval<std::vector<uint8_t>&>()))>>
+        : std::is_same<void, decltype(serialize_binary(std::declval<const T&>(), std::declval<std::vector<uint8_t>&>()))> {};
+
+    template<typename T> inline constexpr bool has_external_serialize_binary_v = has_external_serialize_binary<T>::value;
+
+
+    template<typename, typename = void> struct has_deserialize_binary : std::false_type {};
+
+    template<typename T>
+    struct has_deserialize_binary<T, std::void_t<decltype(std::declval<T&>().deserialize_binary(std::declval<const uint8_t*>(), std::declval<size_t>()))>>
+        : std::is_same<void, decltype(std::declval<T&>().deserialize_binary(std::declval<const uint8_t*>(), std::declval<size_t>()))> {};
+
+    template<typename T> inline constexpr bool has_deserialize_binary_v = has_deserialize_binary<T>::value;
+
+
+    template<typename, typename = void> struct has_external_deserialize_binary : std::false_type {};
+
+    template<typename T>
+    struct has_external_deserialize_binary<
+        T, std::void_t<decltype(deserialize_binary(std::declval<T&>(), std::declval<const uint8_t*>(), std::declval<size_t>()))>>
+        : std::is_same<void, decltype(deserialize_binary(std::declval<T&>(), std::declval<const uint8_t*>(), std::declval<size_t>()))> {};
+
+    template<typename T> inline constexpr bool has_external_deserialize_binary_v = has_external_deserialize_binary<T>::value;
+
+
+    template<typename T>
+    inline constexpr bool is_json_constructible_v = std::is_constructible_v<T, SerializedData<T>> && std::is_constructible_v<SerializedData<T>, const T&>;
+
+    template<typename T> inline constexpr bool is_json_serializable_v = is_json_constructible_v<T> || has_serialize_v<T> || has_external_serialize_v<T>;
+
+    template<typename T>
+    inline constexpr bool is_json_deserializable_v =
+        (is_json_constructible_v<T> && !std::is_empty_v<T> && std::is_move_assignable_v<T>)
+        || (std::is_default_constructible_v<T> && (is_json_constructible_v<T> || has_deserialize_v<T> || has_external_deserialize_v<T>));
+
+    template<typename T> JObject component_to_json(const T& t) {
+        if constexpr (is_json_constructible_v<T>)
+            return JObject(SerializedData<T>(t));
+        else if constexpr (has_serialize_v<T>)
+            return JObject(t.serialize());
+        else
+            return JObject(serialize(t));
+    }
+
+    template<typename T> void component_from_json(T& t, const JObject& json) {
+        if constexpr (is_json_constructible_v<T>)
+            t = T(SerializedData<T>(json));
+        else if constexpr (has_deserialize_v<T>)
+            t.deserialize(SerializedData<T>(json));
+        else
+            deserialize(t, SerializedData<T>(json));
+    }
+
+
+    /**
+     * @brief The position of every entity of a tree in a list of them, so the components of a type can be collected by
+     * walking that type's bucket once, instead of asking every entity in the tree for one
+     */
+    struct EntityIndex {
+        static constexpr uint32_t none = static_cast<uint32_t>(-1);
+
+        std::vector<MGMecs<>::Entity> entities{};
+
+        // Indexed by the index part of the entity handles
+        std::vector<uint32_t> positions{};
+
+        EntityIndex() = default;
+
+        explicit EntityIndex(std::vector<MGMecs<>::Entity> entity_list) : entities{std::move(entity_list)} {
+            for (uint32_t i = 0; i < entities.size(); ++i) {
+                const auto index = static_cast<size_t>(entities[i].index());
+                if (index >= positions.size())
+                    positions.resize(index + 1, none);
+                positions[index] = i;
+            }
+        }
+
+        uint32_t find(const MGMecs<>::Entity e) const {
+            const auto index = static_cast<size_t>(e.index());
+            if (index >= positions.size() || positions[index] == none || entities[positions[index]] != e)
+                return none;
+            return positions[index];
+        }
+
+        size_t size() const { return entities.size(); }
+    };
+
+    /**
+     * @brief Call fn(position, component) for every entity of the index which has a T, by walking T's bucket (empty types may
+     * be stored as tags, which have no entities to walk, so each entity is asked for those instead)
+     *
+     * The bucket is locked for the whole walk, so fn must not add or remove components of type T. The walk only reads, so
+     * the components aren't stamped as changed
+     */
+    template<typename T, typename Fn> void each_component_in(const MGMecs<>& ecs, const EntityIndex& index, Fn&& fn) {
+        if constexpr (std::is_empty_v<T>) {
+            for (uint32_t i = 0; i < index.size(); ++i)
+                if (const T* const t = ecs.try_get<T>(index.entities[i]))
+                    fn(i, *t);
+        }
+        else {
+            ecs.group().include<T>().each([&](const MGMecs<>::Entity e, const T& t) {
+                const auto position = index.find(e);
+                if (position != EntityIndex::none)
+                    fn(position, t);
+            });
+        }
+    }
+
+
+    // Overwrites the components of the targets which already have one, and adds the rest in one batch (values[i] belongs
+    // to targets[i], and is moved from)
+    template<typename T> void emplace_or_assign(MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& targets, std::vector<T>& values) {
+        std::vector<MGMecs<>::Entity> added{};
+        added.reserve(targets.size());
+        for (size_t i = 0; i < targets.size(); ++i) {
+            if (T* const t = ecs.try_get<T>(targets[i]))
+                *t = std::move(values[i]);
+            else {
+                if (added.size() != i)
+                    values[added.size()] = std::move(values[i]);
+                added.emplace_back(targets[i]);
+            }
+        }
+        ecs.emplace_each<T>(added.begin(), added.end(), values.begin());
+    }
+
+    /**
+     * @brief Components of one type read from a Json scene, waiting to be added to the entities of the scene, which aren't
+     * created until every component was decoded (and are destroyed again if committing the components fails, so a scene
+     * which fails to load doesn't leave half a tree behind)
+     */
+    struct StagedComponents {
+        // The position of each component's node in the depth-first order of the scene, and its Json
+        std::vector<uint32_t> positions{};
+        std::vector<const JObject*> jsons{};
+
+        virtual ~StagedComponents() = default;
+
+        // Called once every component is staged, before any of them are decoded
+        virtual void prepare() = 0;
+
+        // Decode the components in [begin, end), called from worker threads for disjoint ranges at once
+        virtual void decode(size_t begin, size_t end) = 0;
+
+        // Add the components to the entities at their positions (or overwrite the ones the entities already have), on the
+        // loading thread
+        virtual void commit(MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& entities) = 0;
+    };
+
+    template<typename T> struct StagedComponentsOf : StagedComponents {
+        // Components built from their Json are built on the workers, the rest deserialize into the component on their entity
+        // when committed, since they may use engine services (like the resource manager) which aren't safe to use from other
+        // threads
+        static constexpr bool decode_on_worker =
+            is_json_constructible_v<T> && std::is_default_constructible_v<T> && !std::is_empty_v<T> && std::is_move_assignable_v<T>;
+
+        std::vector<T> values{};
+
+        void prepare() override {
+            if constexpr (decode_on_worker)
+                values.resize(jsons.size());
+        }
+
+        void decode(const size_t begin, const size_t end) override {
+            if constexpr (decode_on_worker)
+                for (size_t i = begin; i < end; ++i) values[i] = T(SerializedData<T>(*jsons[i]));
+        }
+
+        void commit(MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& entities) override {
+            std::vector<MGMecs<>::Entity> targets(positions.size());
+            for (size_t i = 0; i < positions.size(); ++i) targets[i] = entities[positions[i]];
+
+            if constexpr (decode_on_worker)
+                emplace_or_assign(ecs, targets, values);
+            else if constexpr (is_json_constructible_v<T> && !std::is_empty_v<T>) {
+                for (size_t i = 0; i < targets.size(); ++i) {
+                    if (T* const t = ecs.try_get<T>(targets[i]))
+                        *t = T(SerializedData<T>(*jsons[i]));
+                    else
+                        ecs.emplace<T>(targets[i], T(SerializedData<T>(*jsons[i])));
+                }
+            }
+            else {
+                ecs.try_emplace<T>(targets.begin(), targets.end());
+                for (size_t i = 0; i < targets.size(); ++i) component_from_json(ecs.get<T>(targets[i]), *jsons[i]);
+            }
+        }
+    };
+
+    /**
+     * @brief The binary scene format. A scene is the magic and version, then the hierarchy (the number of nodes, and for each
+     * node in depth-first order the index of its parent and its name), then a block for every serialized type used in the
+     * scene. A block is the type's unique identifier and its size, followed by the encoding, the number of components and the
+     * indices of the nodes they belong to, and then the components themselves. All numbers are little endian
+     */
+    namespace binary_scene {
+        // Numbers and raw components are copied as they are in memory
+        static_assert(std::endian::native == std::endian::little, "The binary scene format is only implemented for little endian platforms");
+
+        inline constexpr char magic[4] = {'M', 'G', 'S', 'C'};
+        inline constexpr uint32_t version = 1;
+        inline constexpr uint32_t no_parent = static_cast<uint32_t>(-1);
+
+        enum class Encoding : uint8_t {
+            // The size of one component, then all of them back to back, for types which are raw_encodable (written byte for
+            // byte, so they shouldn't hold pointers or handles)
+            RAW = 0,
+            // For each component its size, then what serialize_binary wrote
+            BINARY = 1,
+            // For each component the length of its Json, then the Json text, for types with no binary serialization
+            JSON = 2,
+        };
+
+        inline void write(std::vector<uint8_t>& out, const void* data, const size_t size) {
+            const auto bytes = static_cast<const uint8_t*>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+
+        template<typename V> void write_value(std::vector<uint8_t>& out, const V value) {
+            static_assert(std::is_trivially_copyable_v<V>);
+            write(out, &value, sizeof(V));
+        }
+
+        /**
+         * @brief Reads from a buffer (possibly a mapped file) without copying it, and throws instead of reading past its end
+         */
+        struct Reader {
+            const uint8_t* pos = nullptr;
+            const uint8_t* end = nullptr;
+
+            const uint8_t* take(const size_t size) {
+                if (static_cast<size_t>(end - pos) < size)
+                    throw std::runtime_error("Binary scene data ends unexpectedly");
+                const auto res = pos;
+                pos += size;
+                return res;
+            }
+
+            template<typename V> V read_value() {
+                static_assert(std::is_trivially_copyable_v<V>);
+                V res{};
+                std::memcpy(&res, take(sizeof(V)), sizeof(V));
+                return res;
+            }
+        };
+
+        template<typename T>
+        inline constexpr bool binary_serializable = std::is_default_constructible_v<T> && (has_serialize_binary_v<T> || has_external_serialize_binary_v<T>)
+                                                    && (has_deserialize_binary_v<T> || has_external_deserialize_binary_v<T>);
+
+        /**
+         * @brief Whether the bytes of a type are exactly its value, so it can be written byte for byte instead of going
+         * through its Json: it has no padding (which would make saving the same scene twice give different files), and its Json
+         * is nothing more than its members. Nothing can check the second part, so types opt in with a static constexpr bool
+         * raw_encodable member, or by specializing this for types which can't have one. Empty types always qualify
+         */
+        template<typename T, typename = void> struct raw_encodable : std::bool_constant<std::is_empty_v<T>> {};
+
+        template<typename T>
+        struct raw_encodable<T, std::void_t<decltype(T::raw_encodable)>> : std::bool_constant<T::raw_encodable> {};
+
+        // Binary serialization the type provides comes first, then its raw bytes if it opted in, and Json otherwise
+        template<typename T> constexpr Encoding encoding_of() {
+            if constexpr (binary_serializable<T>)
+                return Encoding::BINARY;
+            else if constexpr (raw_encodable<T>::value && std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T> && std::is_move_assignable_v<T>)
+                return Encoding::RAW;
+            else
+                return Encoding::JSON;
+        }
+
+        // Only types which can be written into the Json format get a block, so both formats always hold the same data
+        template<typename T>
+        inline constexpr bool supported = is_json_serializable_v<T> && (encoding_of<T>() != Encoding::JSON || is_json_deserializable_v<T>);
+
+        /**
+         * @brief Write the block contents (everything after the size) for the components of type T on the entities of the
+         * index, walking T's bucket once
+         *
+         * @return false If none of the entities have the component, in which case nothing is written
+         */
+        template<typename T> bool write_block(const MGMecs<>& ecs, const EntityIndex& index, std::vector<uint8_t>& out) {
+            constexpr auto encoding = encoding_of<T>();
+
+            // Every component is encoded while its bucket is locked, and written out afterwards in the order of the index
+            std::vector<uint32_t> positions{};
+            std::vector<size_t> offsets{};
+            std::vector<uint8_t> encoded{};
+            each_component_in<T>(ecs, index, [&](const uint32_t position, const T& t) {
+                positions.emplace_back(position);
+                offsets.emplace_back(encoded.size());
+
+                if constexpr (encoding == Encoding::RAW) {
+                    if constexpr (!std::is_empty_v<T>)
+                        write(encoded, &t, sizeof(T));
+                }
+                else if constexpr (encoding == Encoding::BINARY) {
+                    const auto size_at = encoded.size();
+                    write_value(encoded, uint64_t{0});
+                    if constexpr (has_serialize_binary_v<T>)
+                        t.serialize_binary(encoded);
+                    else
+                        serialize_binary(t, encoded);
+                    const auto size = static_cast<uint64_t>(encoded.size() - size_at - sizeof(uint64_t));
+                    std::memcpy(encoded.data() + size_at, &size, sizeof(size));
+                }
+                else {
+                    const std::string text = component_to_json(t);
+                    write_value(encoded, static_cast<uint64_t>(text.size()));
+                    write(encoded, text.data(), text.size());
+                }
+            });
+            if (positions.empty())
+                return false;
+            offsets.emplace_back(encoded.size());
+
+            std::vector<size_t> order(positions.size());
+            for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+            std::sort(order.begin(), order.end(), [&](const size_t a, const size_t b) { return positions[a] < positions[b]; });
+
+            write_value(out, encoding);
+            write_value(out, static_cast<uint32_t>(positions.size()));
+            for (const auto i : order) write_value(out, positions[i]);
+
+            if constexpr (encoding == Encoding::RAW)
+                write_value(out, static_cast<uint32_t>(std::is_empty_v<T> ? 0 : sizeof(T)));
+            for (const auto i : order) write(out, encoded.data() + offsets[i], offsets[i + 1] - offsets[i]);
+            return true;
+        }
+
+        /**
+         * @brief Add the components of a block written by write_block<T> to the entities it was written from (in the same
+         * order), in one batch for each type. Entities which already have the component get it overwritten
+         */
+        template<typename T> void read_block(MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& entities, Reader& block) {
+            const auto encoding = block.read_value<Encoding>();
+            const auto count = block.read_value<uint32_t>();
+
+            std::vector<MGMecs<>::Entity> targets(count);
+            const auto indices = block.take(static_cast<size_t>(count) * sizeof(uint32_t));
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t index{};
+                std::memcpy(&index, indices + i * sizeof(uint32_t), sizeof(uint32_t));
+                if (index >= entities.size())
+                    throw std::runtime_error("Binary scene component refers to a node outside the scene");
+                targets[i] = entities[index];
+            }
+
+            if constexpr (encoding_of<T>() == Encoding::RAW) {
+                if (encoding == Encoding::RAW) {
+                    if (block.read_value<uint32_t>() != (std::is_empty_v<T> ? 0 : sizeof(T)))
+                        throw std::runtime_error("The layout of a component type changed since the scene was saved, it has to be re-saved from the Json format");
+
+                    if constexpr (std::is_empty_v<T>)
+                        ecs.try_emplace<T>(targets.begin(), targets.end());
+                    else {
+                        const auto data = block.take(static_cast<size_t>(count) * sizeof(T));
+                        std::vector<T> values(count);
+                        std::memcpy(values.data(), data, static_cast<size_t>(count) * sizeof(T));
+                        emplace_or_assign(ecs, targets, values);
+                    }
+                    return;
+                }
+            }
+
+            if constexpr (encoding_of<T>() == Encoding::BINARY) {
+                if (encoding == Encoding::BINARY) {
+                    ecs.try_emplace<T>(targets.begin(), targets.end());
+                    for (const auto e : targets) {
+                        const auto size = static_cast<size_t>(block.read_value<uint64_t>());
+                        const auto data = block.take(size);
+                        if constexpr (has_deserialize_binary_v<T>)
+                            ecs.get<T>(e).deserialize_binary(data, size);
+                        else
+                            deserialize_binary(ecs.get<T>(e), data, size);
+                    }
+                    return;
+                }
+            }
+
+            // Json blocks can still be read after a type gained a faster encoding
+            if constexpr (is_json_deserializable_v<T>) {
+                if (encoding == Encoding::JSON) {
+                    std::vector<JObject> jsons{};
+                    jsons.reserve(count);
+                    for (size_t i = 0; i < count; ++i) {
+                        const auto size = static_cast<size_t>(block.read_value<uint64_t>());
+                        const auto text = reinterpret_cast<const char*>(block.take(size));
+                        jsons.emplace_back(text, text + size);
+                    }
+
+                    if constexpr (is_json_constructible_v<T> && !std::is_empty_v<T> && std::is_move_assignable_v<T>) {
+                        std::vector<T> values{};
+                        values.reserve(count);
+                        for (const auto& json : jsons) values.emplace_back(SerializedData<T>(json));
+                        emplace_or_assign(ecs, targets, values);
+                    }
+                    else {
+                        ecs.try_emplace<T>(targets.begin(), targets.end());
+                        for (size_t i = 0; i < count; ++i) component_from_json(ecs.get<T>(targets[i]), jsons[i]);
+                    }
+                    return;
+                }
+            }
+
+            throw std::runtime_error("Components were saved in an encoding their type can't be read from anymore");
+        }
+    } // namespace binary_scene
+
+
     class EntityComponentSystem : public System {
         template<typename T> friend struct SerializedData;
 
@@ -201,6 +648,24 @@ namespace mgm {
             std::function<bool(const MGMecs<>::Entity entity)> inspect_function{};
 #endif
 
+            // Starts reordering the components of this type, and returns a function which advances the reordering (see
+            // MGMecs::SortPass). Empty for types which can't be reordered, and the function it returns is empty while the
+            // type's bucket is owned by a group
+            std::function<std::function<bool(size_t budget)>(const std::vector<MGMecs<>::Entity>& order)> sort_as{};
+
+            // Serializes the components of this type on the entities of the index into Json, adding each one to the object at
+            // the entity's position (see serialize_scene)
+            std::function<void(const EntityIndex& index, std::vector<JObject>& components)> serialize_many{};
+
+            // Writes the components of this type on the entities of the index as one block of the binary scene format (see
+            // binary_scene::write_block), empty for types which can't be written into the Json format either
+            std::function<bool(const EntityIndex& index, std::vector<uint8_t>& out)> serialize_binary{};
+            std::function<void(const std::vector<MGMecs<>::Entity>& entities, binary_scene::Reader& block)> deserialize_binary{};
+
+            // Creates the staging buffer components of this type are read into when loading a Json scene (see
+            // StagedComponents), empty for types which can't be read from Json
+            std::function<std::unique_ptr<StagedComponents>()> stage{};
+
             bool enable_as_raw_component = false;
         };
 
@@ -208,6 +673,22 @@ namespace mgm {
         std::unordered_map<std::string, SerializedType> serialized_types{};
         std::unordered_map<size_t, std::string> types_unique_ids{};
 
+        // Indexed by MGMecs<>::TypeID, so the components an entity has can be matched to their serialized types directly
+        std::vector<std::pair<const std::string*, const SerializedType*>> serialized_types_by_ecs_id{};
+
+        std::vector<std::function<bool(size_t budget)>> hierarchy_sort_steps{};
+
+        // The serialized components of every entity in the index, by position, collected one type at a time
+        std::vector<JObject> serialize_components(const EntityIndex& index);
+
+        // The children of entity in the format of serialize_node, taking their components from ones collected by
+        // serialize_components
+        JObject serialize_node(const MGMecs<>::Entity entity, const EntityIndex& index, std::vector<JObject>& components);
+
+        // Create the nodes of a tree in one batch, from their names and the positions of their parents in depth-first order,
+        // making entity the root (at position 0), and return the entities by position
+        std::vector<MGMecs<>::Entity> create_hierarchy(const MGMecs<>::Entity entity, const std::vector<uint32_t>& parents, std::vector<std::string>& names);
+
       public:
         MGMecs<> ecs;
         MGMecs<>::Entity root;
@@ -315,7 +796,45 @@ namespace mgm {
                 };
             }
 
+            if constexpr (std::is_move_constructible_v<T> && std::is_move_assignable_v<T> && !std::is_empty_v<T> && !has_stable_storage<T>{}) {
+                type.sort_as = [](const std::vector<MGMecs<>::Entity>& order) -> std::function<bool(size_t)> {
+                    auto& world = MagmaEngine{}.ecs().ecs;
+                    if (world.owned_by_group<T>())
+                        return {};
+                    return [pass = world.sort_as<T>(order.begin(), order.end())](const size_t budget) mutable {
+                        return pass.step(budget);
+                    };
+                };
+            }
+
+            if constexpr (is_json_serializable_v<T>) {
+                type.serialize_many = [unique_identifier](const EntityIndex& index, std::vector<JObject>& components) {
+                    each_component_in<T>(std::as_const(MagmaEngine{}.ecs().ecs), index, [&](const uint32_t position, const T& t) {
+                        auto json = component_to_json(t);
+                        if (!json.empty())
+                            components[position][unique_identifier] = std::move(json);
+                    });
+                };
+            }
+
+            if constexpr (is_json_deserializable_v<T>)
+                type.stage = []() -> std::unique_ptr<StagedComponents> { return std::make_unique<StagedComponentsOf<T>>(); };
+
+            if constexpr (binary_scene::supported<T>) {
+                type.serialize_binary = [](const EntityIndex& index, std::vector<uint8_t>& out) {
+                    return binary_scene::write_block<T>(std::as_const(MagmaEngine{}.ecs().ecs), index, out);
+                };
+                type.deserialize_binary = [](const std::vector<MGMecs<>::Entity>& entities, binary_scene::Reader& block) {
+                    binary_scene::read_block<T>(MagmaEngine{}.ecs().ecs, entities, block);
+                };
+            }
+
             types_unique_ids[typeid(T).hash_code()] = unique_identifier;
+
+            const size_t ecs_type_id = MGMecs<>::TypeID<T>{};
+            if (serialized_types_by_ecs_id.size() <= ecs_type_id)
+                serialized_types_by_ecs_id.resize(ecs_type_id + 1);
+            serialized_types_by_ecs_id[ecs_type_id] = {&serialized_types.find(unique_identifier)->first, &type};
         }
 
         /**
@@ -365,6 +884,20 @@ namespace mgm {
             return it->second;
         }
 
+        /**
+         * @brief Get the unique identifier of a type using its typeid hash
+         *
+         * @param type_hash The typeid(T).hash_code() of the type
+         * @return std::string The identifier of the type, or an empty string if it isn't registered
+         */
+        std::string type_unique_identifier(const size_t type_hash) const {
+            std::unique_lock lock{mutex};
+            const auto it = types_unique_ids.find(type_hash);
+            if (it == types_unique_ids.end())
+                return "";
+            return it->second;
+        }
+
         /**
          * @brief Add a component to the entity using its registered unique ID (if it's registered)
          *
@@ -422,12 +955,90 @@ namespace mgm {
         /**
          * @brief Create a hierarchy with the given entity as its root, and using the given Json data to load the children
          *
+         * The components are decoded on the shared thread pool before any entity is created, so constructors from Json
+         * (SerializedData<T>) may run on worker threads, while types which deserialize into an existing component are
+         * always deserialized on the calling thread
+         *
          * @param entity The entity to make into the new root of the tree to deserialize (can be non-root, new tree will pe
          * placed under the given antity anyway)
          * @param json The json to load the data from
          */
         void deserialize_node(const MGMecs<>::Entity entity, const JObject& json);
 
+        /**
+         * @brief Dump a whole scene into json (the root's name and components, and then its children, all the way down the
+         * hierarchy), in the format scene files are saved in
+         *
+         * @param entity The root of the scene
+         */
+        JObject serialize_scene(const MGMecs<>::Entity entity);
+
+        /**
+         * @brief Dump a whole scene into the binary scene format (see binary_scene), which holds the same data as
+         * serialize_scene, but keeps the components of each type together so they can be loaded in bulk
+         *
+         * @param entity The root of the scene
+         */
+        std::vector<uint8_t> serialize_scene_binary(const MGMecs<>::Entity entity);
+
+        /**
+         * @brief Load a scene in the binary scene format into the given entity, and create its hierarchy below it
+         *
+         * @param entity The entity to make into the root of the scene
+         * @param data The scene data (can point straight into a mapped file, it's not needed after this returns)
+         * @param size The size of the data in bytes
+         */
+        void deserialize_scene_binary(const MGMecs<>::Entity entity, const uint8_t* data, size_t size);
+
+        enum class SceneFormat {
+            JSON,
+            BINARY
+        };
+
+        /**
+         * @brief Get the format of the scene file at path (Json for files that don't exist yet)
+         */
+        SceneFormat scene_format(const Path& path);
+
+        /**
+         * @brief Load the scene file at path (in either format) into the given entity
+         */
+        void load_scene(const MGMecs<>::Entity entity, const Path& path);
+
+        /**
+         * @brief Save the scene with the given root to path, in the given format
+         */
+        void save_scene(const MGMecs<>::Entity entity, const Path& path, SceneFormat format);
+
+        /**
+         * @brief Rewrite the scene file at path in the given format (from the opened scene, if it's opened in the editor)
+         */
+        void convert_scene(const Path& path, SceneFormat format);
+
+        /**
+         * @brief Get the entities of a tree in depth-first order (the order the renderer walks it in)
+         *
+         * @param entity The root of the tree, which is the first entity in the result
+         */
+        std::vector<MGMecs<>::Entity> hierarchy_order(const MGMecs<>::Entity entity) const;
+
+        /**
+         * @brief Start reordering the hierarchy nodes and the components of all serialized types in the depth-first order of
+         * all loaded hierarchies, so walking a tree touches memory mostly front to back. The reordering is done a little every
+         * frame, and replaces the one in progress, if any
+         */
+        void sort_by_hierarchy();
+
+        /**
+         * @brief Continue the reordering started by sort_by_hierarchy (called once per frame by the engine)
+         *
+         * @param budget How many entities the reordering of each component type may visit in this step
+         * @return true If no reordering is in progress anymore
+         */
+        bool step_hierarchy_sort(size_t budget);
+
+        size_t hierarchy_sort_budget = 1024;
+
 #if defined(ENABLE_EDITOR)
         bool draw_palette_options() override;
 #endif
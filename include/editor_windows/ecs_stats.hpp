@@ -0,0 +1,40 @@
+#pragma once
+#include "systems/editor.hpp"
+#include "tools/mgmecs.hpp"
+#include <unordered_map>
+#include <vector>
+
+
+namespace mgm {
+    class EcsStatsWindow : public EditorWindow {
+        static constexpr size_t history_size = 240;
+        static constexpr float sample_interval = 0.25f;
+
+        // A ring of the last history_size samples of one value, oldest first when drawn from next
+        struct History {
+            std::vector<float> values = std::vector<float>(history_size);
+            size_t next = 0;
+
+            void push(float value);
+        };
+
+        float time_since_last_sample = sample_interval;
+        MGMecs<>::Stats last{};
+        size_t last_latent_destruction = 0;
+
+        History total_bytes{};
+        History entities{};
+        History latent_destruction{};
+        History entity_locks{};
+        std::unordered_map<size_t, History> bucket_bytes{};
+
+        void sample();
+
+      public:
+        EcsStatsWindow() {
+            window_name = "ECS Statistics";
+        }
+
+        void draw_contents() override;
+    };
+} // namespace mgm
@@ -0,0 +1,170 @@
+#pragma once
+#include "ecs.hpp"
+#include "file.hpp"
+#include "json.hpp"
+#include "tools/mgmecs.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+namespace mgm {
+    /**
+     * @brief Autosave of a scene opened in the editor, which appends the edits made to it to a journal next to the scene file
+     * (the scene's path with ".journal" added), and only every once in a while folds them into the scene file itself
+     *
+     * Records address nodes by the indices of the children leading to them from the root. Structural edits are recorded as
+     * they happen, so their paths match the tree at that point, and the components of the nodes edited since the last flush
+     * are recorded after them. A journal begins with the hash of the scene file it applies to, so a journal left over from
+     * before the scene file was rewritten some other way is ignored
+     *
+     * Converting the records to text, writing them, and compacting Json scenes happens on a thread of the journal's own,
+     * which keeps a Json copy of the scene with every record applied to it. Binary scenes have no such copy, so compacting
+     * them serializes the scene on the thread which owns the journal, which is why that only happens once the journal grew
+     * large compared to the scene, and when the journal is closed
+     */
+    class SceneJournal {
+      public:
+        using NodePath = std::vector<uint32_t>;
+
+      private:
+        // The journals of the scenes open right now, by the paths of their scene files. Only used from the editor thread
+        static inline std::unordered_map<Path, SceneJournal*> open_journals{};
+
+        Path scene_path{};
+        Path journal_path{};
+        MGMecs<>::Entity root{};
+
+        // Found once when the journal is opened, the file is never probed again from the owning thread while the worker may
+        // be rewriting it
+        bool scene_is_json = true;
+
+        // Only used from the thread which owns the journal
+        std::vector<JObject> pending{};
+        std::vector<MGMecs<>::Entity> edited{};
+        size_t records_since_compaction = 0;
+
+        // Only used from the worker
+        JObject mirror{};
+        bool mirror_valid = false;
+
+        std::atomic<size_t> journal_bytes = 0;
+        std::atomic<size_t> scene_bytes = 0;
+        std::atomic<bool> mirror_lost = false;
+
+        std::mutex mutex{};
+        std::condition_variable cv{};
+        std::deque<std::function<void()>> jobs{};
+        bool stopping = false;
+
+        std::thread worker{};
+
+        void run();
+        void push_job(std::function<void()> job);
+
+        // Record the components of the edited nodes, and hand everything recorded to the worker
+        void hand_over();
+
+        // Apply a record to the mirror, throwing if it doesn't fit the tree
+        void apply_to_mirror(const JObject& record);
+
+        // Rewrite the journal as just a header for the scene file with the given hash
+        void restart_journal(uint64_t scene_hash);
+
+        void compact_from_mirror();
+        void compact_from_binary(const std::vector<uint8_t>& data);
+
+      public:
+        /**
+         * @brief Start journaling the scene at scene_path, which was just loaded into scene_root. If a journal left by an
+         * earlier session applies to the scene file, its edits are applied to the loaded scene first
+         */
+        SceneJournal(const Path& scene_file_path, MGMecs<>::Entity scene_root);
+
+        SceneJournal(const SceneJournal&) = delete;
+        SceneJournal& operator=(const SceneJournal&) = delete;
+
+        /**
+         * @brief Get the journal of the scene file at the path, or null if no journal is open for it
+         */
+        static SceneJournal* of(const Path& scene_file_path);
+
+        /**
+         * @brief Get the path of the entity from the root of its scene, or nothing if it isn't part of the scene
+         */
+        static std::optional<NodePath> path_of(const MGMecs<>& ecs, MGMecs<>::Entity scene_root, MGMecs<>::Entity entity);
+
+        /**
+         * @brief Get the entity at the path from the root of the scene, or null if there is none
+         */
+        static MGMecs<>::Entity resolve(const MGMecs<>& ecs, MGMecs<>::Entity scene_root, const NodePath& path);
+
+        /**
+         * @brief Record a node which was just created (with its name)
+         */
+        void record_create(MGMecs<>::Entity entity);
+
+        /**
+         * @brief Record a node which is about to be destroyed (along with its children)
+         */
+        void record_destroy(MGMecs<>::Entity entity);
+
+        /**
+         * @brief Record a node which was just moved, from the path it had before the move
+         */
+        void record_move(const NodePath& from, MGMecs<>::Entity entity);
+
+        /**
+         * @brief Record the new name of a node
+         */
+        void record_rename(MGMecs<>::Entity entity);
+
+        /**
+         * @brief Mark the components of a node as edited, they're recorded with the next flush
+         */
+        void mark_edited(MGMecs<>::Entity entity);
+
+        /**
+         * @brief Whether anything was recorded since the last flush
+         */
+        bool has_changes() const { return !pending.empty() || !edited.empty(); }
+
+        /**
+         * @brief Hand the records made since the last flush to the worker, to be appended to the journal, and compact the
+         * journal if it grew large compared to the scene
+         */
+        void flush();
+
+        /**
+         * @brief Flush, and fold the journal into the scene file. Binary scenes are serialized on the calling thread, Json
+         * scenes on the worker
+         */
+        void compact();
+
+        /**
+         * @brief Whether compacting leaves serializing the scene to the worker, instead of doing it on the calling thread
+         */
+        bool compacts_off_thread() const { return scene_is_json && !mirror_lost; }
+
+        /**
+         * @brief Save the scene, with every edit made to it, in another format, and journal the edits made afterwards against
+         * the converted file. The scene is serialized on the calling thread, and written by the worker after everything
+         * handed to it before
+         */
+        void convert(EntityComponentSystem::SceneFormat format);
+
+        /**
+         * @brief Finish writing everything handed to the worker, without compacting
+         */
+        ~SceneJournal();
+    };
+} // namespace mgm
@@ -1,4 +1,5 @@
 #pragma once
+#include "editor_windows/scene_journal.hpp"
 #include "file.hpp"
 #include "mgmgpu.hpp"
 #include "systems/editor.hpp"
@@ -42,10 +43,15 @@ namespace mgm {
 
         static inline thread_local MGMecs<>::Entity current_scene_root{};
 
+        // The journal of the current scene, which the hierarchy and inspector record their edits into
+        static inline thread_local SceneJournal* current_journal = nullptr;
+
         static inline float time_since_last_edit = 0.0f;
 
         MGMecs<>::Entity this_viewport_scene_root{};
         Path this_viewport_scene_path{};
+        std::unique_ptr<SceneJournal> journal{};
+        float time_since_last_compaction = 0.0f;
 
         vec2i32 old_size{};
 
@@ -2,10 +2,61 @@
 #include "built-in_components/renderable.hpp"
 #include "mgmgpu.hpp"
 #include "systems.hpp"
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 
 namespace mgm {
+    /**
+     * @brief Everything the render thread needs to draw one frame, copied out of the ECS at the end of an update frame
+     */
+    struct RenderSnapshot {
+        struct Item {
+            MgmGPU::ShaderHandle shader = MgmGPU::INVALID_SHADER;
+            MgmGPU::BuffersObjectHandle buffers_object = MgmGPU::INVALID_BUFFERS_OBJECT;
+            mat4f transform{};
+        };
+
+        std::vector<Item> items{};
+    };
+
+    /**
+     * @brief Hands snapshots from the update thread to the render thread without either of them waiting for the other
+     *
+     * Besides the snapshot each thread is using, a third one holds the newest finished snapshot, which the threads exchange
+     * theirs with atomically. The render thread keeps drawing the same snapshot until a newer one is published
+     */
+    class RenderSnapshotBuffer {
+        static constexpr size_t fresh_bit = 4;
+
+        std::array<RenderSnapshot, 3> snapshots{};
+        size_t writing = 0;
+        size_t reading = 1;
+        std::atomic<size_t> ready{2};
+
+      public:
+        /**
+         * @brief Get the snapshot to fill next (only call from the update thread)
+         */
+        RenderSnapshot& back() { return snapshots[writing]; }
+
+        /**
+         * @brief Make the snapshot returned by back() the newest one
+         */
+        void publish() { writing = ready.exchange(writing | fresh_bit, std::memory_order_acq_rel) & ~fresh_bit; }
+
+        /**
+         * @brief Get the newest published snapshot (only call from the render thread), it stays valid until the next call
+         */
+        const RenderSnapshot& front() {
+            if ((ready.load(std::memory_order_relaxed) & fresh_bit) != 0)
+                reading = ready.exchange(reading, std::memory_order_acq_rel) & ~fresh_bit;
+            return snapshots[reading];
+        }
+    };
+
     class Renderer : public System {
       public:
         std::mutex mutex{};
@@ -17,10 +68,17 @@ namespace mgm {
         Renderer();
 
       private:
-        void gen_draw_calls(EntityComponentSystem& ecs, std::vector<MgmGPU::DrawCall>& draw_calls, MGMecs<>::Entity entity,
-                            const Transform& parent_transform = {});
+        RenderSnapshotBuffer snapshots{};
+
+        void extract(EntityComponentSystem& ecs, RenderSnapshot& snapshot, MGMecs<>::Entity entity, const Transform& parent_transform = {});
 
       public:
+        /**
+         * @brief Copy the components the render thread draws into a new snapshot. Called by the engine on the update thread,
+         * at the end of every frame, once the world stopped changing for that frame
+         */
+        void extract_snapshot();
+
         void graphics_update() override;
 
 #if defined(ENABLE_EDITOR)
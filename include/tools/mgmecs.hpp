@@ -1,17 +1,27 @@
 #pragma once
 #include <algorithm>
 #include <any>
+#include <array>
+#include <atomic>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <tuple>
 #include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -40,6 +50,14 @@ namespace mgm {
 #define HAS_DESTROY \
     has_on_destroy<T, void(Ecs*, const Entity)> {}
 
+    // Components opt into stable storage with a "static constexpr bool stable_storage = true;" member
+    template<typename T, typename = void>
+    struct has_stable_storage : std::false_type {};
+    template<typename T>
+    struct has_stable_storage<T, std::void_t<decltype(T::stable_storage)>> : std::bool_constant<T::stable_storage> {};
+#define HAS_STABLE_STORAGE \
+    has_stable_storage<T> {}
+
     template<typename Key, typename T, size_t max_size = 255>
     class MGMecsConstexprMap {
       public:
@@ -78,19 +96,219 @@ namespace mgm {
     };
 
 
-    template<typename EntityType = uint32_t>
+    // Work-stealing thread pool used to run MGMecs group passes on multiple threads
+    // Every worker takes jobs from the back of its own queue, and steals from the front of the others when it runs dry
+    class MGMecsThreadPool {
+        struct Batch {
+            const std::function<void(size_t)>* task = nullptr;
+            size_t remaining = 0;
+            std::mutex mutex{};
+            std::condition_variable cv{};
+            std::exception_ptr error{};
+        };
+
+        struct Job {
+            Batch* batch = nullptr;
+            size_t index = 0;
+        };
+
+        struct Queue {
+            std::mutex mutex{};
+            std::deque<Job> jobs{};
+        };
+
+        std::vector<std::unique_ptr<Queue>> queues{};
+        std::vector<std::thread> workers{};
+
+        std::mutex sleep_mutex{};
+        std::condition_variable sleep_cv{};
+        std::atomic<size_t> queued{0};
+        bool stopping = false;
+
+        bool try_pop(const size_t queue, Job& job) {
+            std::unique_lock lock{queues[queue]->mutex};
+            if (queues[queue]->jobs.empty())
+                return false;
+            job = queues[queue]->jobs.back();
+            queues[queue]->jobs.pop_back();
+            return true;
+        }
+
+        bool try_steal(const size_t thief, Job& job) {
+            for (size_t i = 1; i <= queues.size(); ++i) {
+                auto& queue = *queues[(thief + i) % queues.size()];
+                std::unique_lock lock{queue.mutex};
+                if (queue.jobs.empty())
+                    continue;
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+                return true;
+            }
+            return false;
+        }
+
+        bool find_job(const size_t self, Job& job) {
+            if ((self < queues.size() && try_pop(self, job)) || try_steal(self, job)) {
+                --queued;
+                return true;
+            }
+            return false;
+        }
+
+        static void execute(const Job& job) {
+            std::exception_ptr error{};
+            try {
+                (*job.batch->task)(job.index);
+            }
+            catch (...) {
+                error = std::current_exception();
+            }
+
+            // The batch lives on the stack of the thread waiting for it, so it must not be touched after the last job is signaled
+            std::unique_lock lock{job.batch->mutex};
+            if (error && !job.batch->error)
+                job.batch->error = error;
+            if (--job.batch->remaining == 0)
+                job.batch->cv.notify_all();
+        }
+
+        void worker_loop(const size_t self) {
+            Job job{};
+            while (true) {
+                if (find_job(self, job)) {
+                    execute(job);
+                    continue;
+                }
+
+                std::unique_lock lock{sleep_mutex};
+                sleep_cv.wait(lock, [this] { return stopping || queued != 0; });
+                if (stopping && queued == 0)
+                    return;
+            }
+        }
+
+      public:
+        explicit MGMecsThreadPool(const size_t worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1) {
+            queues.reserve(worker_count);
+            for (size_t i = 0; i < worker_count; ++i)
+                queues.emplace_back(std::make_unique<Queue>());
+            workers.reserve(worker_count);
+            for (size_t i = 0; i < worker_count; ++i)
+                workers.emplace_back(&MGMecsThreadPool::worker_loop, this, i);
+        }
+
+        MGMecsThreadPool(const MGMecsThreadPool&) = delete;
+        MGMecsThreadPool(MGMecsThreadPool&&) = delete;
+        MGMecsThreadPool& operator=(const MGMecsThreadPool&) = delete;
+        MGMecsThreadPool& operator=(MGMecsThreadPool&&) = delete;
+
+        // Number of threads a batch can run on, including the thread that submits it
+        size_t thread_count() const { return workers.size() + 1; }
+
+        static MGMecsThreadPool& shared() {
+            static MGMecsThreadPool pool{};
+            return pool;
+        }
+
+        // Runs task(i) for every i in [0, count) on the workers and the calling thread, and returns once all of them finished
+        // The first exception thrown by a task is rethrown here after the whole batch completed
+        void parallel_for(const size_t count, const std::function<void(size_t)>& task) {
+            if (count == 0)
+                return;
+            if (workers.empty() || count == 1) {
+                for (size_t i = 0; i < count; ++i)
+                    task(i);
+                return;
+            }
+
+            Batch batch{};
+            batch.task = &task;
+            batch.remaining = count;
+
+            // Counted before pushing, so a worker can never take a job and decrement below zero
+            queued += count;
+            for (size_t q = 0; q < queues.size(); ++q) {
+                std::unique_lock lock{queues[q]->mutex};
+                for (size_t i = q; i < count; i += queues.size())
+                    queues[q]->jobs.push_back(Job{&batch, i});
+            }
+            {
+                std::unique_lock lock{sleep_mutex};
+            }
+            sleep_cv.notify_all();
+
+            Job job{};
+            while (find_job(queues.size(), job))
+                execute(job);
+
+            std::unique_lock lock{batch.mutex};
+            batch.cv.wait(lock, [&batch] { return batch.remaining == 0; });
+            if (batch.error)
+                std::rethrow_exception(batch.error);
+        }
+
+        ~MGMecsThreadPool() {
+            {
+                std::unique_lock lock{sleep_mutex};
+                stopping = true;
+            }
+            sleep_cv.notify_all();
+            for (auto& worker : workers)
+                worker.join();
+        }
+    };
+
+
+    // Stands in for a mutex in worlds which never leave one thread, so locking and unlocking compile to nothing
+    struct MGMecsNullMutex {
+        void lock() {}
+        void unlock() {}
+        bool try_lock() { return true; }
+    };
+
+    // Threading policies for MGMecs, which pick the synchronization a world pays for
+    struct MGMecsMultiThreaded {
+        static constexpr bool thread_safe = true;
+        using Mutex = std::mutex;
+        using RecursiveMutex = std::recursive_mutex;
+    };
+    // For tool-side and offline worlds which are only ever used from one thread: buckets and the world have no mutexes,
+    // entity locks do nothing, and parallel passes run on the calling thread
+    struct MGMecsSingleThreaded {
+        static constexpr bool thread_safe = false;
+        using Mutex = MGMecsNullMutex;
+        using RecursiveMutex = MGMecsNullMutex;
+    };
+
+    template<typename EntityType = uint32_t, typename Policy = MGMecsMultiThreaded>
     class MGMecs {
-        using Ecs = MGMecs<EntityType>;
+        using Ecs = MGMecs<EntityType, Policy>;
+        using Mutex = typename Policy::Mutex;
+        using RecursiveMutex = typename Policy::RecursiveMutex;
 
-        mutable std::recursive_mutex mutex{};
+        mutable RecursiveMutex mutex{};
 
       public:
+        // An entity handle packs a slot index into the low bits, and the version of that slot into the high bits
+        // The version is bumped every time a destroyed entity's slot is recycled, so stale handles can be told apart from live ones
+        static constexpr size_t entity_version_bits = sizeof(EntityType) * 8 * 3 / 8;
+        static constexpr size_t entity_index_bits = sizeof(EntityType) * 8 - entity_version_bits;
+        static constexpr EntityType entity_index_mask = static_cast<EntityType>((EntityType(1) << entity_index_bits) - 1);
+        static constexpr EntityType entity_version_mask = static_cast<EntityType>((EntityType(1) << entity_version_bits) - 1);
+
         class Entity {
           public:
             EntityType value_;
 
             using Type = EntityType;
 
+            static constexpr Entity from_parts(const EntityType index, const EntityType version) {
+                return Entity{static_cast<EntityType>((index & entity_index_mask) | static_cast<EntityType>((version & entity_version_mask) << entity_index_bits))};
+            }
+
+            constexpr EntityType index() const { return static_cast<EntityType>(value_ & entity_index_mask); }
+            constexpr EntityType version() const { return static_cast<EntityType>((value_ >> entity_index_bits) & entity_version_mask); }
+
             constexpr Entity()
                 : value_(null.value_) {}
 
@@ -403,131 +621,326 @@ namespace mgm {
         };
 
       private:
-        template<typename T, typename Hash = std::hash<T>>
-        struct ThreadSafeSet {
-            friend class MGMecs<EntityType>;
+        template<typename... Ts>
+        struct _TypeList {
+            using First = void;
+        };
+        template<typename T, typename... Ts>
+        struct _TypeList<T, Ts...> {
+            using First = T;
+        };
+        template<typename... Ts>
+        struct TypeList {
+            using First = typename _TypeList<Ts...>::First;
+        };
 
-            struct LockStatus {
-                std::thread::id thread_id{};
-                size_t count = 0;
-                bool disallow_further_locking = false;
+        // Per-entity locks, taken either exclusively (recursively, by the thread holding them) or shared by any number of readers
+        // Every entity index gets its own lock word the first time it's locked, which threads sleep on with atomic wait/notify,
+        // so unlocking an entity only wakes the threads waiting for that same entity. The words live in pages indexed by the
+        // entity index, like SparsePages, so finding one takes no mutex: only allocating a page (or growing the directory of
+        // pages) does. Entity indices are recycled, so there are never more words than entities were alive at once
+        // A thread waiting for the exclusive lock keeps new readers out, so a steady stream of readers can't starve it. Threads
+        // remember the shared locks they hold, so taking one again doesn't queue behind such a writer, and trying to take the
+        // exclusive lock while holding a shared one throws instead of deadlocking, so lock exclusively from the start
+        // Single threaded worlds never contend, so all of these do nothing there
+        class EntityLockTable {
+            friend class MGMecs<EntityType, Policy>;
+
+            static constexpr uint32_t exclusive_bit = 1u << 31;
+            static constexpr uint32_t waiters_bit = 1u << 30;
+            static constexpr uint32_t writer_waiting_bit = 1u << 29;
+            static constexpr uint32_t readers_mask = writer_waiting_bit - 1;
+            static constexpr size_t page_size = 1024;
+
+            struct Slot {
+                // exclusive_bit or the number of readers, plus waiters_bit while any thread sleeps on it, and writer_waiting_bit
+                // while a thread waits to lock it exclusively
+                std::atomic<uint32_t> state{0};
+                // Token of the thread holding the exclusive lock, 0 if none
+                std::atomic<uint32_t> owner{0};
+                // How many times the owner locked it, only ever touched by the owner
+                size_t depth = 0;
+            };
 
-                LockStatus()
-                    : thread_id(std::this_thread::get_id()),
-                      count(1),
-                      disallow_further_locking(false) {}
+            struct Page {
+                std::array<Slot, page_size> slots{};
             };
-            std::unordered_map<T, LockStatus, Hash> map{};
-            std::mutex mutex{};
-            std::condition_variable cv{};
-            bool allow_locking = true;
 
-          private:
-            void _unlock(const T& e) {
-                const auto it = map.find(e);
-                if (it == map.end())
-                    throw std::runtime_error("Trying to unlock an entity that was never locked");
-                else if (it->second.thread_id == std::this_thread::get_id()) {
-                    if (--it->second.count == 0) {
-                        if (it->second.disallow_further_locking)
-                            it->second.thread_id = {};
-                        else
-                            map.erase(e);
-                    }
+            struct Directory {
+                size_t size = 0;
+                std::unique_ptr<std::atomic<Page*>[]> pages{};
+
+                explicit Directory(const size_t page_count)
+                    : size{page_count},
+                      pages{std::make_unique<std::atomic<Page*>[]>(page_count)} {}
+            };
+
+            // Pages and directories are never freed while the table lives, so threads which loaded a pointer to one (or are
+            // sleeping on a slot) can keep using it after the directory grew
+            std::atomic<Directory*> directory{nullptr};
+            mutable Mutex grow_mutex{};
+            std::vector<std::unique_ptr<Page>> pages{};
+            std::vector<std::unique_ptr<Directory>> directories{};
+
+            // The shared locks the calling thread holds, by slot, and how many times it took each
+            static std::unordered_map<const Slot*, size_t>& shared_held() {
+                thread_local std::unordered_map<const Slot*, size_t> held{};
+                return held;
+            }
+
+            static uint32_t thread_token() {
+                static std::atomic<uint32_t> next{1};
+                thread_local const uint32_t token = next.fetch_add(1, std::memory_order_relaxed);
+                return token;
+            }
+
+            Slot* find_slot(const Entity e) const {
+                const auto index = static_cast<size_t>(entity_index(e));
+                const auto* dir = directory.load(std::memory_order_acquire);
+                if (dir == nullptr || index / page_size >= dir->size)
+                    return nullptr;
+                auto* const page = dir->pages[index / page_size].load(std::memory_order_acquire);
+                return page != nullptr ? &page->slots[index & (page_size - 1)] : nullptr;
+            }
+            Slot& get_slot(const Entity e) {
+                if (const auto slot = find_slot(e))
+                    return *slot;
+
+                const auto index = static_cast<size_t>(entity_index(e));
+                const std::unique_lock lock{grow_mutex};
+                auto* dir = directory.load(std::memory_order_relaxed);
+                if (dir == nullptr || index / page_size >= dir->size) {
+                    auto grown = std::make_unique<Directory>(std::max(index / page_size + 1, dir != nullptr ? dir->size * 2 : size_t(1)));
+                    for (size_t i = 0; dir != nullptr && i < dir->size; ++i)
+                        grown->pages[i].store(dir->pages[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    dir = directories.emplace_back(std::move(grown)).get();
+                    directory.store(dir, std::memory_order_release);
                 }
-                else
-                    throw std::runtime_error("Trying to unlock an entity that was locked by a different thread");
+
+                auto* page = dir->pages[index / page_size].load(std::memory_order_relaxed);
+                if (page == nullptr) {
+                    page = pages.emplace_back(std::make_unique<Page>()).get();
+                    dir->pages[index / page_size].store(page, std::memory_order_release);
+                }
+                return page->slots[index & (page_size - 1)];
             }
 
-          public:
-            void unlock(const T& e) {
-                {
-                    std::unique_lock lock{mutex};
-                    _unlock(e);
+            static void acquire(Slot& slot, const bool exclusive) {
+                auto state = slot.state.load(std::memory_order_relaxed);
+                while (true) {
+                    // Readers also wait while a writer does, the writer clears the bit once it got the lock
+                    const bool available = exclusive ? (state & (exclusive_bit | readers_mask)) == 0 : (state & (exclusive_bit | writer_waiting_bit)) == 0;
+                    if (available) {
+                        const auto locked = exclusive ? (state & ~writer_waiting_bit) + exclusive_bit : state + 1;
+                        if (slot.state.compare_exchange_weak(state, locked, std::memory_order_acquire, std::memory_order_relaxed))
+                            return;
+                        continue;
+                    }
+                    const auto waiting = state | waiters_bit | (exclusive ? writer_waiting_bit : 0);
+                    if (waiting != state && !slot.state.compare_exchange_weak(state, waiting, std::memory_order_relaxed))
+                        continue;
+                    slot.state.wait(waiting, std::memory_order_relaxed);
+                    state = slot.state.load(std::memory_order_relaxed);
                 }
-                cv.notify_all();
             }
-            template<typename It>
-            void unlock(const It& begin, const It& end) {
-                {
-                    std::unique_lock lock{mutex};
-                    for (auto it = begin; it != end; ++it)
-                        _unlock(*it);
+            static void release(Slot& slot, const uint32_t amount) {
+                const auto state = slot.state.fetch_sub(amount, std::memory_order_release) - amount;
+                // Another thread may grab the lock between these, but then the woken threads just go back to sleep on it
+                // Writers which wake up and still can't lock it set writer_waiting_bit again
+                if ((state & waiters_bit) != 0 && (state & (exclusive_bit | readers_mask)) == 0) {
+                    slot.state.fetch_and(~waiters_bit, std::memory_order_relaxed);
+                    slot.state.notify_all();
                 }
-                cv.notify_all();
             }
 
-          private:
-            void _wait_and_lock(const T& e) {
-                const auto it = map.find(e);
-                if (it == map.end())
-                    map.emplace(e, LockStatus{});
-                else if (it->second.thread_id == std::this_thread::get_id())
-                    ++it->second.count;
-                else
-                    throw std::runtime_error("INTERNAL ERROR: Trying to lock an entity that is already locked by another thread");
+            // Locks are always taken in index order, so two threads locking overlapping sets can't deadlock each other
+            template<typename It>
+            static std::vector<Entity> in_lock_order(const It& begin, const It& end) {
+                std::vector<Entity> res{begin, end};
+                std::sort(res.begin(), res.end(), [](const Entity a, const Entity b) { return a.index() < b.index(); });
+                return res;
+            }
+
+            void move_from(EntityLockTable& other) {
+                std::scoped_lock lock{grow_mutex, other.grow_mutex};
+                pages = std::move(other.pages);
+                directories = std::move(other.directories);
+                directory.store(other.directory.exchange(nullptr, std::memory_order_acq_rel), std::memory_order_release);
+                other.pages.clear();
+                other.directories.clear();
             }
 
           public:
-            void wait_and_lock(const T& e) {
-                {
-                    std::unique_lock lock{mutex};
-                    if (!allow_locking || map.find(e) != map.end())
-                        cv.wait(lock, [this, e] {
-                            if (!allow_locking)
-                                return false;
+            // Entities locked right now (exclusively or shared), and lock words allocated so far
+            size_t held() const {
+                const std::unique_lock lock{grow_mutex};
+                size_t res = 0;
+                for (const auto& page : pages)
+                    for (const auto& slot : page->slots)
+                        if ((slot.state.load(std::memory_order_relaxed) & (exclusive_bit | readers_mask)) != 0)
+                            ++res;
+                return res;
+            }
+            size_t slot_count() const {
+                const std::unique_lock lock{grow_mutex};
+                return pages.size() * page_size;
+            }
 
-                            const auto it = map.find(e);
-                            if (it == map.end())
-                                return true;
-                            return it->second.thread_id == std::this_thread::get_id();
-                        });
-                    _wait_and_lock(e);
+            void wait_and_lock(const Entity e) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                auto& slot = get_slot(e);
+                const auto token = thread_token();
+                if (slot.owner.load(std::memory_order_relaxed) == token) {
+                    ++slot.depth;
+                    return;
                 }
-                cv.notify_all();
+                const auto& held = shared_held();
+                if (!held.empty() && held.contains(&slot))
+                    throw std::runtime_error("Trying to lock an entity exclusively while holding a shared lock on it");
+                acquire(slot, true);
+                slot.owner.store(token, std::memory_order_relaxed);
+                slot.depth = 1;
             }
             template<typename It>
             void wait_and_lock(const It& begin, const It& end) {
-                std::unique_lock lock{mutex};
-                cv.wait(lock, [&]() {
-                    return allow_locking;
-                });
+                if constexpr (!Policy::thread_safe)
+                    return;
+                for (const auto e : in_lock_order(begin, end))
+                    wait_and_lock(e);
+            }
 
-                bool any_locked = false;
-                for (auto it = begin; it != end; ++it) {
-                    if (map.find(*it) != map.end()) {
-                        any_locked = true;
-                        break;
+            // Locks the entity exclusively only if no other thread holds it, without waiting
+            bool try_lock(const Entity e) {
+                if constexpr (!Policy::thread_safe)
+                    return true;
+                auto& slot = get_slot(e);
+                const auto token = thread_token();
+                if (slot.owner.load(std::memory_order_relaxed) == token) {
+                    ++slot.depth;
+                    return true;
+                }
+                auto state = slot.state.load(std::memory_order_relaxed);
+                while ((state & (exclusive_bit | readers_mask)) == 0)
+                    if (slot.state.compare_exchange_weak(state, state + exclusive_bit, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        slot.owner.store(token, std::memory_order_relaxed);
+                        slot.depth = 1;
+                        return true;
                     }
+                return false;
+            }
+
+            void unlock(const Entity e) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                const auto slot = find_slot(e);
+                if (slot == nullptr || (slot->state.load(std::memory_order_relaxed) & exclusive_bit) == 0)
+                    throw std::runtime_error("Trying to unlock an entity that was never locked");
+                if (slot->owner.load(std::memory_order_relaxed) != thread_token())
+                    throw std::runtime_error("Trying to unlock an entity that was locked by a different thread");
+                if (--slot->depth == 0) {
+                    slot->owner.store(0, std::memory_order_relaxed);
+                    release(*slot, exclusive_bit);
                 }
-                allow_locking = false;
+            }
+            template<typename It>
+            void unlock(const It& begin, const It& end) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                for (auto it = begin; it != end; ++it)
+                    unlock(*it);
+            }
 
-                if (any_locked) {
-                    cv.wait(lock, [this, begin, end] {
-                        bool any_still_locked = false;
-                        for (auto e_it = begin; e_it != end; ++e_it) {
-                            const auto it = map.find(*e_it);
-                            if (it != map.end()) {
-                                if (it->second.thread_id != std::this_thread::get_id()) {
-                                    any_still_locked = true;
-                                    break;
-                                }
-                            }
-                        }
-                        return !any_still_locked;
-                    });
+            // Any number of threads can hold the shared lock at once, while no thread holds the exclusive one
+            // A thread which already holds the exclusive lock, or a shared one, just locks it once more
+            void wait_and_lock_shared(const Entity e) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                auto& slot = get_slot(e);
+                if (slot.owner.load(std::memory_order_relaxed) == thread_token()) {
+                    ++slot.depth;
+                    return;
+                }
+                auto& held = shared_held();
+                if (!held.empty()) {
+                    const auto it = held.find(&slot);
+                    if (it != held.end()) {
+                        ++it->second;
+                        return;
+                    }
                 }
+                acquire(slot, false);
+                held.emplace(&slot, 1);
+            }
+            template<typename It>
+            void wait_and_lock_shared(const It& begin, const It& end) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                for (const auto e : in_lock_order(begin, end))
+                    wait_and_lock_shared(e);
+            }
 
+            void unlock_shared(const Entity e) {
+                if constexpr (!Policy::thread_safe)
+                    return;
+                const auto slot = find_slot(e);
+                if (slot != nullptr && slot->owner.load(std::memory_order_relaxed) == thread_token()) {
+                    unlock(e);
+                    return;
+                }
+                auto& held = shared_held();
+                const auto it = slot != nullptr ? held.find(slot) : held.end();
+                if (it == held.end())
+                    throw std::runtime_error("Trying to unlock an entity that was never locked by this thread");
+                if (--it->second == 0) {
+                    held.erase(it);
+                    release(*slot, 1);
+                }
+            }
+            template<typename It>
+            void unlock_shared(const It& begin, const It& end) {
+                if constexpr (!Policy::thread_safe)
+                    return;
                 for (auto it = begin; it != end; ++it)
-                    _wait_and_lock(*it);
+                    unlock_shared(*it);
+            }
+        };
 
-                allow_locking = true;
+        // Keep entities locked exclusively until the end of the scope, so a throwing hook or owning group can't leave them locked
+        class HeldEntityLock {
+            EntityLockTable& table;
+            Entity e{};
 
-                lock.unlock();
-                cv.notify_all();
+          public:
+            HeldEntityLock(EntityLockTable& lock_table, const Entity entity)
+                : table{lock_table},
+                  e{entity} {
+                table.wait_and_lock(e);
             }
+            HeldEntityLock(const HeldEntityLock&) = delete;
+            HeldEntityLock& operator=(const HeldEntityLock&) = delete;
+            ~HeldEntityLock() {
+                table.unlock(e);
+            }
+        };
+        template<typename It>
+        class HeldEntityLocks {
+            EntityLockTable& table;
+            It begin;
+            It end;
 
-            ~ThreadSafeSet() = default;
+          public:
+            HeldEntityLocks(EntityLockTable& lock_table, const It& range_begin, const It& range_end)
+                : table{lock_table},
+                  begin{range_begin},
+                  end{range_end} {
+                table.wait_and_lock(begin, end);
+            }
+            HeldEntityLocks(const HeldEntityLocks&) = delete;
+            HeldEntityLocks& operator=(const HeldEntityLocks&) = delete;
+            ~HeldEntityLocks() {
+                table.unlock(begin, end);
+            }
         };
 
         template<typename T>
@@ -648,14 +1061,301 @@ namespace mgm {
             }
         };
 
+        static constexpr EntityType entity_index(const Entity e) {
+            return e.index();
+        }
+
+        // Rough heap footprint of a node-based hash map: its bucket array, plus one node per element
+        template<typename Map>
+        static size_t map_bytes(const Map& map) {
+            return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(typename Map::value_type) + sizeof(void*));
+        }
+
+        // Maps entity IDs to values through lazily allocated fixed-size pages, so a lookup is two array indexes instead of a hash
+        // Value needs a static none() which marks empty slots, and an is_none() check
+        template<typename Value, size_t page_size = 4096>
+        class SparsePages {
+            static_assert((page_size & (page_size - 1)) == 0, "Sparse page size must be a power of two");
+
+            std::vector<std::unique_ptr<Value[]>> pages{};
+            size_t used = 0;
+
+            static constexpr size_t page_of(const Entity e) { return static_cast<size_t>(entity_index(e)) / page_size; }
+            static constexpr size_t slot_of(const Entity e) { return static_cast<size_t>(entity_index(e)) & (page_size - 1); }
+
+          public:
+            SparsePages() = default;
+
+            const Value* find(const Entity e) const {
+                const auto page = page_of(e);
+                if (page >= pages.size() || pages[page] == nullptr)
+                    return nullptr;
+                const Value* val = &pages[page][slot_of(e)];
+                if (val->is_none())
+                    return nullptr;
+                return val;
+            }
+            Value* find(const Entity e) {
+                return const_cast<Value*>(const_cast<const SparsePages*>(this)->find(e));
+            }
+
+            bool contains(const Entity e) const { return find(e) != nullptr; }
+
+            Value& emplace(const Entity e, const Value& value) {
+                const auto page = page_of(e);
+                if (page >= pages.size())
+                    pages.resize(page + 1);
+                if (pages[page] == nullptr) {
+                    pages[page] = std::make_unique<Value[]>(page_size);
+                    std::fill_n(pages[page].get(), page_size, Value::none());
+                }
+
+                Value& slot = pages[page][slot_of(e)];
+                if (slot.is_none())
+                    ++used;
+                slot = value;
+                return slot;
+            }
+
+            void erase(const Entity e) {
+                Value* val = find(e);
+                if (val == nullptr)
+                    return;
+                *val = Value::none();
+                --used;
+            }
+
+            size_t size() const { return used; }
+
+            // Empties every page, keeping them allocated
+            void clear() {
+                for (auto& page : pages)
+                    if (page != nullptr)
+                        std::fill_n(page.get(), page_size, Value::none());
+                used = 0;
+            }
+
+            size_t bytes() const {
+                size_t res = pages.capacity() * sizeof(std::unique_ptr<Value[]>);
+                for (const auto& page : pages)
+                    if (page != nullptr)
+                        res += page_size * sizeof(Value);
+                return res;
+            }
+        };
+
+        // Raw storage for components in fixed-size pages, which are never reallocated, so a component keeps its address for as
+        // long as it exists. Doesn't track which slots hold a live component, the bucket using it constructs and destroys them
+        template<typename T, size_t page_size = 1024>
+        class StablePages {
+            struct alignas(T) Page {
+                std::byte data[sizeof(T) * page_size];
+            };
+
+            std::vector<std::unique_ptr<Page>> pages{};
+            size_t slots = 0;
+
+            T* slot_ptr(const size_t i) const {
+                return reinterpret_cast<T*>(pages[i / page_size]->data) + (i & (page_size - 1));
+            }
+
+          public:
+            static_assert((page_size & (page_size - 1)) == 0, "Stable page size must be a power of two");
+
+            StablePages() = default;
+
+            // Number of slots handed out so far, including the ones without a live component
+            size_t size() const { return slots; }
+            size_t capacity() const { return pages.size() * page_size; }
+            size_t bytes() const { return capacity() * sizeof(T) + pages.capacity() * sizeof(std::unique_ptr<Page>); }
+
+            void reserve(const size_t n) {
+                while (capacity() < n)
+                    pages.emplace_back(new Page);
+            }
+
+            T& operator[](const size_t i) { return *std::launder(slot_ptr(i)); }
+            const T& operator[](const size_t i) const { return *std::launder(slot_ptr(i)); }
+
+            // Constructs a component either in an empty slot, or in the one right after the last slot
+            template<typename... Ts>
+            T& emplace_at(const size_t i, Ts&&... args) {
+                if (i == slots)
+                    reserve(slots + 1);
+                T* const res = new (slot_ptr(i)) T(std::forward<Ts>(args)...);
+                if (i == slots)
+                    ++slots;
+                return *res;
+            }
+            void destroy_at(const size_t i) { (*this)[i].~T(); }
+
+            // Forgets every slot and hands out n new ones without constructing anything in them, keeping the pages
+            // The caller destroys the live components first, and constructs the ones it needs with emplace_at
+            void reset(const size_t n) {
+                reserve(n);
+                slots = n;
+            }
+
+            // Slot the component is stored in, or -1 if it's not stored here
+            size_t index_of(const T* component) const {
+                for (size_t p = 0; p < pages.size(); ++p) {
+                    const T* first = reinterpret_cast<const T*>(pages[p]->data);
+                    if (std::less_equal<>{}(first, component) && std::less<>{}(component, first + page_size))
+                        return p * page_size + static_cast<size_t>(component - first);
+                }
+                return static_cast<size_t>(-1);
+            }
+        };
+
+        // Notified by the buckets it owns whenever one of their components is created or is about to be destroyed
+        // Called without holding the notifying bucket's lock, so it can lock all the buckets it owns in a fixed order
+        class OwningGroupBase {
+          public:
+            virtual void added(const Entity e) = 0;
+            virtual void removing(const Entity e) = 0;
+            // Packs the group again from scratch, after its buckets were replaced wholesale
+            virtual void rebuild() = 0;
+            virtual ~OwningGroupBase() = default;
+        };
+
+      public:
+        // A snapshot of one component bucket's occupancy and memory use, see MGMecs::stats
+        struct BucketStats {
+            size_t type_id = 0;
+            // typeid(T).hash_code() and typeid(T).name(), so tools can match the bucket to their own type registries
+            size_t type_hash = 0;
+            const char* type_name = "";
+            bool tag = false;
+            bool stable = false;
+
+            // Live components, and how many the dense storage has room for before growing
+            size_t count = 0;
+            size_t capacity = 0;
+            // Components destroyed with a pending on_destroy hook, which only go away once the hook returns
+            size_t latent_destruction = 0;
+
+            // Components, their entities and ticks (or the bitset of a tag bucket)
+            size_t dense_bytes = 0;
+            // The entity to component index
+            size_t sparse_bytes = 0;
+            // Hash maps: latent destroyed components and move callbacks
+            size_t map_bytes = 0;
+            float latent_load_factor = 0.0f;
+
+            // Move callbacks registered by iterators
+            size_t callbacks = 0;
+
+            size_t total_bytes() const { return dense_bytes + sparse_bytes + map_bytes; }
+        };
+
+        // A snapshot of the whole world's occupancy and memory use, see MGMecs::stats
+        struct Stats {
+            size_t entities = 0;
+            // Entity indices handed out so far, alive or waiting to be recycled
+            size_t entity_indices = 0;
+            size_t entity_bytes = 0;
+
+            // Entities locked right now, and lock words allocated so far (a page at a time, up to the highest entity index
+            // ever locked)
+            size_t entity_locks_held = 0;
+            size_t entity_lock_slots = 0;
+
+            size_t archetypes = 0;
+            size_t archetype_entities = 0;
+            size_t archetype_bytes = 0;
+
+            std::vector<BucketStats> buckets{};
+
+            size_t total_bytes() const {
+                size_t res = entity_bytes + archetype_bytes;
+                for (const auto& bucket : buckets)
+                    res += bucket.total_bytes();
+                return res;
+            }
+        };
+
+      private:
+        struct Container;
+
+        // The contents of one bucket, copied by MGMecs::snapshot
+        // Trivially copyable components are stored as raw bytes together with the bucket's bookkeeping, other components
+        // are copy constructed into a typed array which the image shares with its copies
+        struct BucketImage {
+            size_t type_id = 0;
+            // Creates an empty bucket of the right type, when restoring into a world which doesn't have one yet
+            Container* (*create)() = nullptr;
+            std::vector<std::byte> bytes{};
+            std::shared_ptr<const void> objects{};
+        };
+
+        template<typename T>
+        static void write_bytes(std::vector<std::byte>& bytes, const T* data, const size_t n) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            const auto at = bytes.size();
+            bytes.resize(at + n * sizeof(T));
+            if (n != 0)
+                std::memcpy(bytes.data() + at, data, n * sizeof(T));
+        }
+        template<typename T>
+        static void read_bytes(const std::vector<std::byte>& bytes, size_t& at, T* data, const size_t n) {
+            static_assert(std::is_trivially_copyable_v<T>);
+            if (at + n * sizeof(T) > bytes.size())
+                throw std::runtime_error("INTERNAL ERROR: Bucket image is shorter than its contents");
+            if (n != 0)
+                std::memcpy(data, bytes.data() + at, n * sizeof(T));
+            at += n * sizeof(T);
+        }
+
         struct Container {
+            mutable RecursiveMutex mutex{};
+
+            // The owning group that keeps this bucket's dense arrays ordered, if any
+            OwningGroupBase* owner = nullptr;
+
+            // Number of bulk iteration passes currently holding this bucket's lock, structural changes are rejected while non-zero
+            mutable size_t bulk_passes = 0;
+
+            // The world's current tick, which creation and mutable access stamp components with (see MGMecs::advance_tick)
+            std::atomic<uint64_t> tick{1};
+
             Container() = default;
 
+            // Non-zero while the current thread runs part of a parallel group pass
+            static inline thread_local size_t parallel_pass_depth = 0;
+
+            void check_structural_change_allowed() const {
+                if (bulk_passes != 0)
+                    throw std::runtime_error("Structural change to a component bucket during a bulk iteration pass");
+            }
+
+            // Must be called before taking the bucket's mutex, since a parallel pass holds it on a different thread
+            static void check_not_in_parallel_pass() {
+                if (parallel_pass_depth != 0)
+                    throw std::runtime_error("Structural change to a component bucket from inside a parallel iteration pass");
+            }
+
             virtual size_t count() const = 0;
             virtual bool try_destroy(Ecs* ecs, const Entity e) = 0;
             virtual bool try_destroy(Ecs* ecs, const GenericIteratorHelper<Entity>& begin, const GenericIteratorHelper<Entity>& end) = 0;
             virtual void destroy_all(Ecs* ecs) = 0;
 
+            // Tick the entity's component was added (or last changed) at, or 0 if it has none, the caller must hold the mutex
+            virtual uint64_t tick_of_unlocked(const Entity e, bool added) const = 0;
+
+            // Whether the entity has a component in this bucket
+            virtual bool has(const Entity e) const = 0;
+
+            virtual BucketStats stats() const = 0;
+
+            // Gives every entity in to a copy of from's component, if from has one, see MGMecs::clone
+            virtual void clone(Ecs* ecs, const Entity from, const std::vector<Entity>& to) = 0;
+
+            // Copies the bucket's contents into an image, the caller must hold the mutex
+            virtual BucketImage save_unlocked() const = 0;
+            // Replaces the bucket's contents with the image's (or empties it, given null) without running any hooks, the
+            // caller must hold the mutex
+            virtual void load_unlocked(const BucketImage* image) = 0;
+
             virtual ~Container() = default;
         };
 
@@ -733,7 +1433,7 @@ namespace mgm {
                         if (helper->currently_calling)
                             helper->to_destroy_after_calls.emplace_back(ToDestroy{.key = key, .p = p});
                         else {
-                            helper->callbacks.at(key).callbacks.erase(p);
+                            helper->erase(key, p);
                             helper = nullptr;
                             p = 0;
                         }
@@ -745,6 +1445,33 @@ namespace mgm {
                 }
             };
 
+          private:
+            // Keys without callbacks are dropped, so empty() doesn't have to walk them
+            void erase(const Key& key, const size_t p) {
+                const auto it = callbacks.find(key);
+                if (it == callbacks.end())
+                    return;
+                it->second.callbacks.erase(p);
+                if (it->second.callbacks.empty())
+                    callbacks.erase(it);
+            }
+
+          public:
+            bool empty() const { return callbacks.empty(); }
+
+            size_t size() const {
+                size_t res = 0;
+                for (const auto& [key, collection] : callbacks)
+                    res += collection.callbacks.size();
+                return res;
+            }
+            size_t bytes() const {
+                size_t res = map_bytes(callbacks);
+                for (const auto& [key, collection] : callbacks)
+                    res += map_bytes(collection.callbacks);
+                return res;
+            }
+
             [[nodiscard]] CallbackHandle create(const Key& key, const CB& callback) {
                 auto it = callbacks.find(key);
 
@@ -776,7 +1503,7 @@ namespace mgm {
 
                 currently_calling = false;
                 for (const auto& [k, p] : to_destroy_after_calls)
-                    callbacks.at(k).callbacks.erase(p);
+                    erase(k, p);
                 to_destroy_after_calls.clear();
 
                 return res;
@@ -795,14 +1522,19 @@ namespace mgm {
 
                 currently_calling = false;
                 for (const auto& [k, p] : to_destroy_after_calls)
-                    callbacks.at(k).callbacks.erase(p);
+                    erase(k, p);
                 to_destroy_after_calls.clear();
             }
         };
 
+        // Empty component types without hooks are tags, which only need to remember which entities have them
         template<typename T>
+        static constexpr bool is_tag = std::is_empty_v<T> && !HAS_CONSTRUCT && !HAS_DESTROY;
+
+        template<typename T, bool = is_tag<T>>
         struct ComponentBucket : public Container {
-            mutable std::recursive_mutex mutex{};
+            using Container::mutex;
+            static constexpr bool tag_storage = false;
 
             struct Component {
                 bool latent_destruction : 1 = false;
@@ -847,13 +1579,39 @@ namespace mgm {
                     c /= other.c;
                     return *this;
                 }
+
+                // Marks an empty slot in the sparse pages (no latent destruction ID ever reaches this value)
+                static Component none() {
+                    Component res{};
+                    res.latent_destruction = true;
+                    res.c = (EntityType(1) << (sizeof(EntityType) * 8 - 1)) - 1;
+                    return res;
+                }
+                bool is_none() const {
+                    return latent_destruction && c == none().c;
+                }
             };
 
-            std::vector<T> components{};
+            // Stable buckets never move their components: a destroyed component leaves a hole (null in original), which the
+            // next created one fills, so pointers to components stay valid, and iterators don't need to listen for moves
+            // Iterating walks the holes too, so a stable bucket which shrank a lot is slower to iterate than a packed one
+            static constexpr bool stable_storage = HAS_STABLE_STORAGE;
+
+            std::conditional_t<stable_storage, StablePages<T>, std::vector<T>> components{};
             std::vector<Entity> original{};
-            std::unordered_map<Entity, Component, typename Entity::Hash> map{};
+            SparsePages<Component> sparse{};
+            // Holes left in a stable bucket, reused last in first out
+            std::vector<size_t> free_slots{};
 
-            std::unordered_map<EntityType, T*> latent_destruction_components{};
+            // Parallel to components, the tick each component was created at, and the tick it was last accessed mutably at
+            std::vector<uint64_t> added_ticks{};
+            std::vector<uint64_t> changed_ticks{};
+
+            struct LatentComponent {
+                T* component = nullptr;
+                Entity e{};
+            };
+            std::unordered_map<EntityType, LatentComponent> latent_destruction_components{};
             EntityType ldc_id_p = EntityType(0);
 
             using CompMoveCallbacks = CallbacksHelper<Entity, void(ComponentBucket<T>& originating_bucket, size_t from, size_t to), typename Entity::Hash>;
@@ -863,16 +1621,36 @@ namespace mgm {
 
             size_t count() const override {
                 std::unique_lock lock{mutex};
-                return components.size() + latent_destruction_components.size();
+                // A stable bucket keeps a component in its slot until on_destroy returned (and the slot is only freed then),
+                // so it's counted by its slot already
+                if constexpr (stable_storage)
+                    return original.size() - free_slots.size();
+                else
+                    return original.size() + latent_destruction_components.size();
             }
 
           private:
+            // Looks up the sparse slot of the entity's index, and makes sure it belongs to this exact handle and not to a stale one
+            const Component* find(const Entity e) const {
+                const Component* c = sparse.find(e);
+                if (c == nullptr)
+                    return nullptr;
+                if (c->latent_destruction) {
+                    const auto it = latent_destruction_components.find(c->c);
+                    return it != latent_destruction_components.end() && it->second.e == e ? c : nullptr;
+                }
+                return original[c->c] == e ? c : nullptr;
+            }
+            Component* find(const Entity e) {
+                return const_cast<Component*>(const_cast<const ComponentBucket<T>*>(this)->find(e));
+            }
+
             const T* _get(const Component& c) const {
                 if (c.latent_destruction) {
                     const auto it = latent_destruction_components.find(c.c);
                     if (it == latent_destruction_components.end())
                         return nullptr;
-                    return it->second;
+                    return it->second.component;
                 }
                 return &components[c.c];
             }
@@ -880,16 +1658,81 @@ namespace mgm {
                 return const_cast<T*>(const_cast<const ComponentBucket<T>*>(this)->_get(c));
             }
 
+            // Stores a new component for the entity, filling a hole first in stable buckets, the caller must hold the mutex
+            template<typename... Ts>
+            void push_unlocked(const Entity e, Ts&&... args) {
+                const auto now = this->tick.load(std::memory_order_relaxed);
+                if constexpr (stable_storage) {
+                    if (!free_slots.empty()) {
+                        const auto c = free_slots.back();
+                        components.emplace_at(c, std::forward<Ts>(args)...);
+                        free_slots.pop_back();
+                        original[c] = e;
+                        added_ticks[c] = now;
+                        changed_ticks[c] = now;
+                        sparse.emplace(e, Component{c});
+                        return;
+                    }
+                    components.emplace_at(components.size(), std::forward<Ts>(args)...);
+                }
+                else
+                    components.emplace_back(std::forward<Ts>(args)...);
+                original.emplace_back(e);
+                added_ticks.emplace_back(now);
+                changed_ticks.emplace_back(now);
+                sparse.emplace(e, Component{original.size() - 1});
+            }
+
+            // Removes a component which was just pushed, when the owning group refused to take its entity in, so the entity doesn't
+            // keep all of the owned components while sitting outside of the group. The caller must hold the mutex
+            void take_back_unlocked(const Entity e) {
+                if constexpr (!stable_storage) {
+                    const auto c = find(e);
+                    if (c == nullptr)
+                        return;
+                    swap_and_pop(*c);
+                    sparse.erase(e);
+                }
+            }
+
+            // Makes room for n more components, so pushing them doesn't reallocate midway, the caller must hold the mutex
+            void reserve_unlocked(const size_t n) {
+                const auto size = original.size() + n;
+                components.reserve(size);
+                original.reserve(size);
+                added_ticks.reserve(size);
+                changed_ticks.reserve(size);
+            }
+
           public:
             template<typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
             T& create(Ecs* ecs, const Entity e, Ts&&... args) {
+                Container::check_not_in_parallel_pass();
                 std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
-                if (map.find(e) != map.end())
+                if (sparse.contains(e))
                     throw std::runtime_error("Entity already contains a component of this type");
-                map.emplace(e, components.size());
-                original.emplace_back(e);
-                T& component = components.emplace_back(std::forward<Ts>(args)...);
+                push_unlocked(e, std::forward<Ts>(args)...);
+
+                if (this->owner != nullptr) {
+                    lock.unlock();
+                    try {
+                        this->owner->added(e);
+                    }
+                    catch (...) {
+                        lock.lock();
+                        take_back_unlocked(e);
+                        throw;
+                    }
+                    lock.lock();
+                }
+
+                // The owning group may have moved the component
+                const auto c = find(e);
+                if (c == nullptr)
+                    throw std::runtime_error("Component was removed while it was being created");
+                T& component = components[c->c];
 
                 if constexpr (HAS_CONSTRUCT)
                     if (ecs != nullptr)
@@ -900,81 +1743,201 @@ namespace mgm {
 
             template<typename It, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
             bool try_create(Ecs* ecs, const It& begin, const It& end, Ts&&... args) {
+                return try_create_batch(ecs, begin, end, [&](const It& it) { push_unlocked(*it, std::forward<Ts>(args)...); });
+            }
+
+            // Same as try_create, but the component of the i-th entity is move constructed from values[i]
+            template<typename It, typename VIt>
+            bool try_create_each(Ecs* ecs, const It& begin, const It& end, const VIt& values) {
+                return try_create_batch(ecs, begin, end, [&](const It& it) {
+                    push_unlocked(*it, std::move(*std::next(values, std::distance(begin, it))));
+                });
+            }
+
+          private:
+            // Pushes a component for every entity in [begin, end) which doesn't have one yet, by calling push with the
+            // iterator to it, then runs the notifications and hooks for all of them
+            template<typename It, typename Push>
+            bool try_create_batch(Ecs* ecs, const It& begin, const It& end, const Push& push) {
+                Container::check_not_in_parallel_pass();
                 std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
-                std::vector<std::pair<T*, Component>> constructed{};
+                std::vector<Entity> constructed{};
                 constructed.reserve(std::distance(begin, end));
-
-                const auto original_size = original.size();
+                reserve_unlocked(static_cast<size_t>(std::distance(begin, end)));
 
                 for (auto it = begin; it != end; ++it) {
-                    if (map.find(*it) != map.end())
+                    if (sparse.contains(*it))
                         continue;
-                    map.emplace(*it, components.size());
-                    original.emplace_back(*it);
-                    constructed.emplace_back(&components.emplace_back(std::forward<Ts>(args)...), components.size() - 1);
+                    push(it);
+                    constructed.emplace_back(*it);
                 }
 
                 lock.unlock();
 
+                if (this->owner != nullptr) {
+                    for (size_t i = 0; i < constructed.size(); ++i) {
+                        try {
+                            this->owner->added(constructed[i]);
+                        }
+                        catch (...) {
+                            lock.lock();
+                            for (size_t j = i; j < constructed.size(); ++j)
+                                take_back_unlocked(constructed[j]);
+                            throw;
+                        }
+                    }
+                }
+
+                // Looked up again, since the components may have been moved by an owning group or by hooks creating more of them
                 if constexpr (HAS_CONSTRUCT)
                     if (ecs != nullptr)
-                        for (const auto& [component, c] : constructed)
-                            component->on_construct(ecs, original[c]);
+                        for (const auto e : constructed)
+                            if (T* const component = try_get(e))
+                                component->on_construct(ecs, e);
                 return true;
             }
 
+          public:
             const T& get(const Entity e) const {
                 std::unique_lock lock{mutex};
-                const auto c = map.at(e);
-                const auto component = _get(c);
+                const auto c = find(e);
+                if (c == nullptr)
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                const auto component = _get(*c);
                 if (component == nullptr)
                     throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
                 return *component;
             }
             T& get(const Entity e) {
-                const T& val = const_cast<const ComponentBucket<T>*>(this)->get(e);
-                return const_cast<T&>(val);
+                std::unique_lock lock{mutex};
+                const auto c = find(e);
+                if (c == nullptr)
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                const auto component = _get(*c);
+                if (component == nullptr)
+                    throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                mark_changed(*c);
+                return *component;
             }
 
             template<typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
             T& get_or_create(Ecs* ecs, const Entity e, Ts&&... args) {
                 std::unique_lock lock{mutex};
-                const auto it = map.find(e);
-                if (it == map.end()) {
+                const auto c = find(e);
+                if (c == nullptr) {
                     lock.unlock();
                     return create(ecs, e, std::forward<Ts>(args)...);
                 }
-                const auto component = _get(it->second);
+                const auto component = _get(*c);
                 if (component == nullptr)
                     throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                mark_changed(*c);
                 return *component;
             }
 
             const T* try_get(const Entity e) const {
                 std::unique_lock lock{mutex};
-                const auto it = map.find(e);
-                if (it == map.end())
+                const auto c = find(e);
+                if (c == nullptr)
                     return nullptr;
-                const auto component = _get(it->second);
+                const auto component = _get(*c);
                 if (component == nullptr)
                     throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
                 return component;
             }
             T* try_get(const Entity e) {
-                const T* val = const_cast<const ComponentBucket<T>*>(this)->try_get(e);
-                return const_cast<T*>(val);
+                std::unique_lock lock{mutex};
+                const auto c = find(e);
+                if (c == nullptr)
+                    return nullptr;
+                const auto component = _get(*c);
+                if (component == nullptr)
+                    throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                mark_changed(*c);
+                return component;
+            }
+
+            // Same as try_get, but the caller must already hold the bucket's mutex
+            const T* try_get_unlocked(const Entity e) const {
+                const auto c = find(e);
+                if (c == nullptr)
+                    return nullptr;
+                return _get(*c);
+            }
+            T* try_get_unlocked(const Entity e) {
+                const auto c = find(e);
+                if (c == nullptr)
+                    return nullptr;
+                mark_changed(*c);
+                return _get(*c);
+            }
+
+            // Same as get, but the caller must already hold the bucket's mutex
+            const T& get_unlocked(const Entity e) const {
+                const auto c = find(e);
+                if (c == nullptr)
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                const auto component = _get(*c);
+                if (component == nullptr)
+                    throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                return *component;
+            }
+            T& get_unlocked(const Entity e) {
+                const auto c = find(e);
+                if (c == nullptr)
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                const auto component = _get(*c);
+                if (component == nullptr)
+                    throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                mark_changed(*c);
+                return *component;
+            }
+
+            uint64_t tick_of_unlocked(const Entity e, const bool added) const override {
+                const auto c = find(e);
+                if (c == nullptr || c->latent_destruction)
+                    return 0;
+                return added ? added_ticks[c->c] : changed_ticks[c->c];
             }
 
+            bool has(const Entity e) const override { return try_get(e) != nullptr; }
+
           private:
+            // Components being destroyed are not tracked anymore
+            void mark_changed(const Component& c) {
+                if (!c.latent_destruction)
+                    changed_ticks[c.c] = this->tick.load(std::memory_order_relaxed);
+            }
+
+            // Destroys the component in a slot of a stable bucket, which was already hidden by setting its entity to null
+            void free_slot(const size_t c) {
+                components.destroy_at(c);
+                free_slots.emplace_back(c);
+            }
+
             bool _destroy(Ecs* ecs, const Component c) {
                 if (ecs == nullptr)
                     return false;
 
+                if constexpr (stable_storage) {
+                    original[c.c] = null;
+                    free_slot(c.c);
+                    return true;
+                }
+                else
+                    return swap_and_pop(c);
+            }
+
+            // Moves the last component into the destroyed one's place, and lets the iterators know about it
+            bool swap_and_pop(const Component c) {
                 if (c.c == components.size() - 1) {
                     const auto o = original.back();
                     components.pop_back();
                     original.pop_back();
+                    added_ticks.pop_back();
+                    changed_ticks.pop_back();
                     comp_move_callbacks(o, *this, original.size(), static_cast<size_t>(-1));
                     return true;
                 }
@@ -982,9 +1945,13 @@ namespace mgm {
                 const auto o = original.back();
                 std::swap(components[c.c], components.back());
                 std::swap(original[c.c], original.back());
-                map[original[c.c]] = c;
+                added_ticks[c.c] = added_ticks.back();
+                changed_ticks[c.c] = changed_ticks.back();
+                sparse.emplace(original[c.c], c);
                 components.pop_back();
                 original.pop_back();
+                added_ticks.pop_back();
+                changed_ticks.pop_back();
 
                 comp_move_callbacks(o, *this, original.size(), c.c);
 
@@ -996,20 +1963,44 @@ namespace mgm {
                 if (ecs == nullptr)
                     return false;
 
+                Container::check_not_in_parallel_pass();
+                if (this->owner != nullptr)
+                    this->owner->removing(e);
+
                 std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
-                const auto it = map.find(e);
-                if (it == map.end())
+                Component* const found = find(e);
+                if (found == nullptr)
                     return false;
 
-                Component& c = it->second;
+                Component& c = *found;
 
-                if constexpr (HAS_DESTROY) {
+                if constexpr (HAS_DESTROY && stable_storage) {
+                    // The component is destroyed in place, and its slot is only reused once on_destroy returned
+                    const size_t slot = c.c;
+                    original[slot] = null;
+
+                    const auto ldc = ldc_id_p++;
+                    latent_destruction_components.emplace(ldc, LatentComponent{&components[slot], e});
+                    c = ldc;
+                    c.latent_destruction = true;
+
+                    lock.unlock();
+                    components[slot].on_destroy(ecs, e);
+                    lock.lock();
+
+                    sparse.erase(e);
+                    latent_destruction_components.erase(ldc);
+                    free_slot(slot);
+                    return true;
+                }
+                else if constexpr (HAS_DESTROY) {
                     T temp{std::move(components[c.c])};
                     _destroy(ecs, c);
 
                     const auto ldc = ldc_id_p++;
-                    latent_destruction_components.emplace(ldc, &temp);
+                    latent_destruction_components.emplace(ldc, LatentComponent{&temp, e});
                     c = ldc;
                     c.latent_destruction = true;
 
@@ -1017,13 +2008,13 @@ namespace mgm {
                     temp.on_destroy(ecs, e);
                     lock.lock();
 
-                    map.erase(e);
+                    sparse.erase(e);
                     latent_destruction_components.erase(ldc);
                     return true;
                 }
                 else {
                     _destroy(ecs, c);
-                    map.erase(e);
+                    sparse.erase(e);
                     return true;
                 }
             }
@@ -1035,7 +2026,13 @@ namespace mgm {
 
                 const auto dist = std::distance(begin, end);
 
+                Container::check_not_in_parallel_pass();
+                if (this->owner != nullptr)
+                    for (auto it = begin; it != end; ++it)
+                        this->owner->removing(*it);
+
                 std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
                 static thread_local std::vector<Component*> to_delete{};
                 if (static_cast<decltype(dist)>(to_delete.capacity()) < dist)
@@ -1044,14 +2041,43 @@ namespace mgm {
 
                 for (auto it = begin; it != end; ++it) {
                     const auto e = *it;
-                    const auto mit = map.find(e);
-                    if (mit != map.end())
-                        to_delete.emplace_back(&mit->second);
+                    const auto c = find(e);
+                    if (c != nullptr)
+                        to_delete.emplace_back(c);
                     else if (abort_on_invalid)
                         return false;
                 }
 
-                if constexpr (HAS_DESTROY) {
+                if constexpr (HAS_DESTROY && stable_storage) {
+                    struct Dying {
+                        size_t slot;
+                        Entity e;
+                        EntityType ldc;
+                    };
+                    std::vector<Dying> dying{};
+                    dying.reserve(to_delete.size());
+                    for (const auto c : to_delete) {
+                        const auto ldc = ldc_id_p++;
+                        dying.emplace_back(Dying{c->c, original[c->c], ldc});
+                        original[c->c] = null;
+                        latent_destruction_components.emplace(ldc, LatentComponent{&components[c->c], dying.back().e});
+                        *c = ldc;
+                        c->latent_destruction = true;
+                    }
+
+                    lock.unlock();
+                    for (const auto& [slot, e, ldc] : dying)
+                        components[slot].on_destroy(ecs, e);
+                    lock.lock();
+
+                    for (const auto& [slot, e, ldc] : dying) {
+                        sparse.erase(e);
+                        latent_destruction_components.erase(ldc);
+                        free_slot(slot);
+                    }
+                    return true;
+                }
+                else if constexpr (HAS_DESTROY) {
                     struct Temp {
                         T t;
                         Entity e;
@@ -1067,7 +2093,7 @@ namespace mgm {
                         const auto ldc = ldc_id_p++;
                         temps.emplace_back(std::move(components[c->c]), original[c->c], ldc);
                         _destroy(ecs, *c);
-                        latent_destruction_components.emplace(ldc, &temps.back().t);
+                        latent_destruction_components.emplace(ldc, LatentComponent{&temps.back().t, temps.back().e});
                         *c = ldc;
                         c->latent_destruction = true;
                     }
@@ -1078,7 +2104,7 @@ namespace mgm {
                     lock.lock();
 
                     for (const auto& [t, e, ldc] : temps) {
-                        map.erase(e);
+                        sparse.erase(e);
                         latent_destruction_components.erase(ldc);
                     }
                     return true;
@@ -1087,7 +2113,7 @@ namespace mgm {
                     for (const auto c : to_delete) {
                         const auto e = original[c->c];
                         _destroy(ecs, *c);
-                        map.erase(e);
+                        sparse.erase(e);
                     }
                     return true;
                 }
@@ -1097,151 +2123,1064 @@ namespace mgm {
                 return try_destroy<GenericIteratorHelper<Entity>>(ecs, begin, end);
             }
 
+            // Swaps two components' places in the dense arrays, the caller must hold the mutex
+            // Move callbacks (which iterators listen to) only describe swap-and-pop moves, so this throws instead of moving
+            // components out from under an iterator
+            void swap_slots_unlocked(const size_t a, const size_t b) {
+                if (a == b)
+                    return;
+                if (!comp_move_callbacks.empty())
+                    throw std::runtime_error("Can't reorder the components of a bucket while an iterator is walking it");
+                using std::swap;
+                swap(components[a], components[b]);
+                swap(original[a], original[b]);
+                swap(added_ticks[a], added_ticks[b]);
+                swap(changed_ticks[a], changed_ticks[b]);
+                sparse.emplace(original[a], Component{a});
+                sparse.emplace(original[b], Component{b});
+            }
+
+            // Index of the entity's component in the dense arrays, or -1 if it has none (or it is being destroyed)
+            size_t dense_index_unlocked(const Entity e) const {
+                const auto c = find(e);
+                if (c == nullptr || c->latent_destruction)
+                    return static_cast<size_t>(-1);
+                return c->c;
+            }
+
+            BucketImage save_unlocked() const override {
+                if (!latent_destruction_components.empty())
+                    throw std::runtime_error("Can't take a snapshot while on_destroy hooks are running");
+                if constexpr (!std::is_trivially_copyable_v<T> && !std::is_copy_constructible_v<T>)
+                    throw std::runtime_error("Can't take a snapshot of a component which isn't copy constructible");
+
+                BucketImage image{};
+                image.type_id = TypeID<T>{};
+                image.create = [] { return static_cast<Container*>(new ComponentBucket<T>{}); };
+
+                const size_t size = original.size();
+                const size_t holes = free_slots.size();
+                write_bytes(image.bytes, &size, 1);
+                write_bytes(image.bytes, &holes, 1);
+                write_bytes(image.bytes, original.data(), size);
+                write_bytes(image.bytes, free_slots.data(), holes);
+                write_bytes(image.bytes, added_ticks.data(), size);
+                write_bytes(image.bytes, changed_ticks.data(), size);
+
+                // Only the live components are saved, in slot order
+                if constexpr (std::is_trivially_copyable_v<T>) {
+                    if constexpr (stable_storage) {
+                        for (size_t i = 0; i < size; ++i)
+                            if (original[i] != null)
+                                write_bytes(image.bytes, &components[i], 1);
+                    }
+                    else
+                        write_bytes(image.bytes, components.data(), size);
+                }
+                else if constexpr (std::is_copy_constructible_v<T>) {
+                    auto objects = std::make_shared<std::vector<T>>();
+                    objects->reserve(size - holes);
+                    for (size_t i = 0; i < size; ++i)
+                        if (!stable_storage || original[i] != null)
+                            objects->emplace_back(components[i]);
+                    image.objects = std::move(objects);
+                }
+                return image;
+            }
+
+            void load_unlocked(const BucketImage* image) override {
+                this->check_structural_change_allowed();
+                if (!latent_destruction_components.empty())
+                    throw std::runtime_error("Can't restore a snapshot while on_destroy hooks are running");
+
+                if constexpr (stable_storage)
+                    for (size_t i = 0; i < original.size(); ++i)
+                        if (original[i] != null)
+                            components.destroy_at(i);
+                sparse.clear();
+                if (image == nullptr) {
+                    if constexpr (stable_storage)
+                        components.reset(0);
+                    else
+                        components.clear();
+                    original.clear();
+                    free_slots.clear();
+                    added_ticks.clear();
+                    changed_ticks.clear();
+                    return;
+                }
+
+                size_t at = 0, size = 0, holes = 0;
+                read_bytes(image->bytes, at, &size, 1);
+                read_bytes(image->bytes, at, &holes, 1);
+                original.resize(size);
+                free_slots.resize(holes);
+                added_ticks.resize(size);
+                changed_ticks.resize(size);
+                read_bytes(image->bytes, at, original.data(), size);
+                read_bytes(image->bytes, at, free_slots.data(), holes);
+                read_bytes(image->bytes, at, added_ticks.data(), size);
+                read_bytes(image->bytes, at, changed_ticks.data(), size);
+
+                if constexpr (stable_storage) {
+                    components.reset(size);
+                    size_t o = 0;
+                    for (size_t i = 0; i < size; ++i) {
+                        if (original[i] == null)
+                            continue;
+                        if constexpr (std::is_trivially_copyable_v<T>)
+                            read_bytes(image->bytes, at, &components.emplace_at(i), 1);
+                        else if constexpr (std::is_copy_constructible_v<T>)
+                            components.emplace_at(i, (*std::static_pointer_cast<const std::vector<T>>(image->objects))[o++]);
+                    }
+                }
+                else if constexpr (std::is_trivially_copyable_v<T>) {
+                    components.resize(size);
+                    read_bytes(image->bytes, at, components.data(), size);
+                }
+                else if constexpr (std::is_copy_constructible_v<T>) {
+                    const auto& objects = *std::static_pointer_cast<const std::vector<T>>(image->objects);
+                    components.clear();
+                    components.reserve(size);
+                    for (const auto& object : objects)
+                        components.emplace_back(object);
+                }
+
+                for (size_t i = 0; i < size; ++i)
+                    if (original[i] != null)
+                        sparse.emplace(original[i], Component{i});
+            }
+
+            void clone(Ecs* ecs, const Entity from, const std::vector<Entity>& to) override {
+                std::unique_lock lock{mutex};
+                const auto c = find(from);
+                if (c == nullptr)
+                    return;
+                if constexpr (std::is_copy_constructible_v<T>) {
+                    // Copied out first, since creating the clones may reallocate the storage the original lives in
+                    const auto component = _get(*c);
+                    if (component == nullptr)
+                        throw std::runtime_error("INTERNAL ERROR: Invalid component ID related to entity");
+                    const T prototype{*component};
+                    lock.unlock();
+                    try_create(ecs, to.begin(), to.end(), prototype);
+                }
+                else
+                    throw std::runtime_error("Can't clone an entity with a component which isn't copy constructible");
+            }
+
+            BucketStats stats() const override {
+                std::unique_lock lock{mutex};
+                BucketStats res{};
+                res.type_id = TypeID<T>{};
+                res.type_hash = typeid(T).hash_code();
+                res.type_name = typeid(T).name();
+                res.stable = stable_storage;
+                res.count = original.size() - free_slots.size();
+                res.capacity = components.capacity();
+                res.latent_destruction = latent_destruction_components.size();
+
+                if constexpr (stable_storage)
+                    res.dense_bytes = components.bytes() + free_slots.capacity() * sizeof(size_t);
+                else
+                    res.dense_bytes = components.capacity() * sizeof(T);
+                res.dense_bytes += original.capacity() * sizeof(Entity) + (added_ticks.capacity() + changed_ticks.capacity()) * sizeof(uint64_t);
+                res.sparse_bytes = sparse.bytes();
+                res.map_bytes = map_bytes(latent_destruction_components) + comp_move_callbacks.bytes();
+                res.latent_load_factor = latent_destruction_components.load_factor();
+                res.callbacks = comp_move_callbacks.size();
+                return res;
+            }
+
             void destroy_all(Ecs* ecs) override {
                 std::unique_lock lock{mutex};
-                const auto original_copy = original;
+                auto original_copy = original;
                 lock.unlock();
 
+                if constexpr (stable_storage)
+                    original_copy.erase(std::remove(original_copy.begin(), original_copy.end(), null), original_copy.end());
                 try_destroy(ecs, original_copy.begin(), original_copy.end());
             }
-        };
-
-        template<typename T>
-        ComponentBucket<T>& get_bucket() {
-            std::unique_lock lock{mutex};
-            return *reinterpret_cast<ComponentBucket<T>*>(buckets.at(TypeID<T>{}));
-        }
-        template<typename T>
-        const ComponentBucket<T>& get_bucket() const {
-            std::unique_lock lock{mutex};
-            return *reinterpret_cast<ComponentBucket<T>*>(buckets.at(TypeID<T>{}));
-        }
 
-        template<typename T>
-        ComponentBucket<T>* try_get_bucket() {
-            std::unique_lock lock{mutex};
-            const auto it = buckets.find(TypeID<T>{});
-            if (it == buckets.end())
-                return nullptr;
-            return reinterpret_cast<ComponentBucket<T>*>(it->second);
-        }
-        template<typename T>
-        const ComponentBucket<T>* try_get_bucket() const {
-            std::unique_lock lock{mutex};
-            const auto it = buckets.find(TypeID<T>{});
-            if (it == buckets.end())
-                return nullptr;
-            return reinterpret_cast<const ComponentBucket<T>*>(it->second);
-        }
+            ~ComponentBucket() override {
+                // Stable pages don't know which of their slots are alive
+                if constexpr (stable_storage)
+                    for (size_t i = 0; i < original.size(); ++i)
+                        if (original[i] != null)
+                            components.destroy_at(i);
+            }
+        };
 
+        // Tags are stored as one bit per entity index, so adding, removing and testing one is a single bit operation, and no
+        // object is ever created for them: every entity with the tag shares the same empty instance
+        // The bits don't know about entity versions, so MGMecs checks handles before they reach the bucket (see reaches_bucket),
+        // and groups never drive a pass from a tag bucket, since it can't list its entities
         template<typename T>
-        ComponentBucket<T>& create_bucket() {
-            std::unique_lock lock{mutex};
-            const auto c = new ComponentBucket<T>{};
-            buckets.emplace(TypeID<T>{}, c);
-            return *c;
-        }
-        template<typename T>
-        ComponentBucket<T>& get_or_create_bucket() {
-            std::unique_lock lock{mutex};
-            const auto it = buckets.find(TypeID<T>{});
-            if (it == buckets.end())
-                return create_bucket<T>();
-            return *reinterpret_cast<ComponentBucket<T>*>(it->second);
-        }
+        struct ComponentBucket<T, true> : public Container {
+            using Container::mutex;
+            static constexpr bool tag_storage = true;
+            static constexpr bool stable_storage = false;
 
-        class EntityManager {
-            std::unordered_set<Entity, typename Entity::Hash> used{};
-            std::priority_queue<Entity, std::vector<Entity>, std::greater<Entity>> available{};
-            Entity next = zero;
+            T instance{};
+            std::vector<uint64_t> bits{};
+            size_t population = 0;
 
-          public:
-            EntityManager() = default;
-            EntityManager(const EntityManager&) = default;
-            EntityManager(EntityManager&&) = default;
-            EntityManager& operator=(const EntityManager&) = default;
-            EntityManager& operator=(EntityManager&&) = default;
+            ComponentBucket() = default;
 
-            Entity create() {
-                if (available.empty()) {
-                    auto e = *used.emplace(next).first;
-                    next = static_cast<Entity>(next + 1);
-                    return e;
-                }
-                const auto id = available.top();
-                available.pop();
-                return *used.emplace(id).first;
+            size_t count() const override {
+                std::unique_lock lock{mutex};
+                return population;
             }
 
-            void destroy(const Entity id) {
-                if (id == next - 1) {
-                    next = (Entity)(next - 1);
-                    while (!available.empty() && available.top() == next - 1) {
-                        available.pop();
-                        next = (Entity)(next - 1);
-                    }
-                }
-                else if (id < next)
-                    available.push(id);
+          private:
+            static size_t word_of(const Entity e) { return static_cast<size_t>(entity_index(e)) / 64; }
+            static uint64_t bit_of(const Entity e) { return uint64_t(1) << (static_cast<size_t>(entity_index(e)) & 63); }
 
-                used.erase(id);
+            bool test(const Entity e) const {
+                const auto word = word_of(e);
+                return word < bits.size() && (bits[word] & bit_of(e)) != 0;
             }
-            bool try_destroy(const Entity id) {
-                if (used.find(id) == used.end())
+            // False if the entity already had the tag
+            bool set(const Entity e) {
+                const auto word = word_of(e);
+                if (word >= bits.size())
+                    bits.resize(word + 1);
+                if ((bits[word] & bit_of(e)) != 0)
                     return false;
-                destroy(id);
+                bits[word] |= bit_of(e);
+                ++population;
+                return true;
+            }
+            // False if the entity didn't have the tag
+            bool reset(const Entity e) {
+                if (!test(e))
+                    return false;
+                bits[word_of(e)] &= ~bit_of(e);
+                --population;
                 return true;
             }
 
-            std::unordered_set<Entity, typename Entity::Hash>& all() { return used; }
-            const std::unordered_set<Entity, typename Entity::Hash>& all() const { return used; }
-
-            ~EntityManager() = default;
-        };
-        EntityManager entities{};
-        std::unordered_map<size_t, Container*> buckets{};
-        ThreadSafeSet<Entity, typename Entity::Hash> locks{};
-
-      public:
-        MGMecs() = default;
-        MGMecs(const MGMecs&) = delete;
-        MGMecs(MGMecs&& other) noexcept {
-            if (this == &other)
-                return;
+          public:
+            template<typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
+            T& create(Ecs*, const Entity e, Ts&&...) {
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
-            std::unique_lock lock{mutex};
-            std::unique_lock other_lock{other.mutex};
+                if (!set(e))
+                    throw std::runtime_error("Entity already contains a component of this type");
+                return instance;
+            }
 
-            for (const auto& g : other.groups)
-                g->ecs_moved(this);
-            for (const auto& l : other.s_locks)
-                l.ecs = this;
+            template<typename It, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
+            bool try_create(Ecs*, const It& begin, const It& end, Ts&&...) {
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
 
-            groups = std::move(other.groups);
-            entities = std::move(other.entities);
-            buckets = std::move(other.buckets);
-            locks = std::move(other.locks);
-            s_locks = std::move(other.s_locks);
-        }
-        MGMecs& operator=(const MGMecs&) = delete;
-        MGMecs& operator=(MGMecs&& other) noexcept {
-            if (this == &other)
-                return *this;
+                for (auto it = begin; it != end; ++it)
+                    set(*it);
+                return true;
+            }
 
-            std::unique_lock lock{mutex};
-            std::unique_lock other_lock{other.mutex};
+            const T& get(const Entity e) const {
+                std::unique_lock lock{mutex};
+                if (!test(e))
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                return instance;
+            }
+            T& get(const Entity e) {
+                std::unique_lock lock{mutex};
+                if (!test(e))
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                return instance;
+            }
+
+            template<typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
+            T& get_or_create(Ecs* ecs, const Entity e, Ts&&... args) {
+                std::unique_lock lock{mutex};
+                if (test(e))
+                    return instance;
+                lock.unlock();
+                return create(ecs, e, std::forward<Ts>(args)...);
+            }
+
+            const T* try_get(const Entity e) const {
+                std::unique_lock lock{mutex};
+                return test(e) ? &instance : nullptr;
+            }
+            T* try_get(const Entity e) {
+                std::unique_lock lock{mutex};
+                return test(e) ? &instance : nullptr;
+            }
+
+            const T* try_get_unlocked(const Entity e) const { return test(e) ? &instance : nullptr; }
+            T* try_get_unlocked(const Entity e) { return test(e) ? &instance : nullptr; }
+            const T& get_unlocked(const Entity e) const {
+                if (!test(e))
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                return instance;
+            }
+            T& get_unlocked(const Entity e) {
+                if (!test(e))
+                    throw std::out_of_range("Entity does not contain a component of this type");
+                return instance;
+            }
+
+            // Tags are never stamped, so change filters on them only check that the entity has the tag
+            uint64_t tick_of_unlocked(const Entity e, const bool) const override {
+                return test(e) ? static_cast<uint64_t>(-1) : 0;
+            }
+
+            bool has(const Entity e) const override { return try_get(e) != nullptr; }
+
+            bool try_destroy(Ecs* ecs, const Entity e) override {
+                if (ecs == nullptr)
+                    return false;
+
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
+                return reset(e);
+            }
+
+            template<typename It>
+            bool try_destroy(Ecs* ecs, const It& begin, const It& end, bool abort_on_invalid = false) {
+                if (ecs == nullptr)
+                    return false;
+
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
+
+                if (abort_on_invalid)
+                    for (auto it = begin; it != end; ++it)
+                        if (!test(*it))
+                            return false;
+                for (auto it = begin; it != end; ++it)
+                    reset(*it);
+                return true;
+            }
+
+            bool try_destroy(Ecs* ecs, const GenericIteratorHelper<Entity>& begin, const GenericIteratorHelper<Entity>& end) override {
+                return try_destroy<GenericIteratorHelper<Entity>>(ecs, begin, end);
+            }
+
+            BucketImage save_unlocked() const override {
+                BucketImage image{};
+                image.type_id = TypeID<T>{};
+                image.create = [] { return static_cast<Container*>(new ComponentBucket<T>{}); };
+                const size_t words = bits.size();
+                write_bytes(image.bytes, &population, 1);
+                write_bytes(image.bytes, &words, 1);
+                write_bytes(image.bytes, bits.data(), words);
+                return image;
+            }
+
+            void load_unlocked(const BucketImage* image) override {
+                this->check_structural_change_allowed();
+                if (image == nullptr) {
+                    bits.clear();
+                    population = 0;
+                    return;
+                }
+                size_t at = 0, words = 0;
+                read_bytes(image->bytes, at, &population, 1);
+                read_bytes(image->bytes, at, &words, 1);
+                bits.resize(words);
+                read_bytes(image->bytes, at, bits.data(), words);
+            }
+
+            void clone(Ecs*, const Entity from, const std::vector<Entity>& to) override {
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
+                if (test(from))
+                    for (const auto e : to)
+                        set(e);
+            }
+
+            BucketStats stats() const override {
+                std::unique_lock lock{mutex};
+                BucketStats res{};
+                res.type_id = TypeID<T>{};
+                res.type_hash = typeid(T).hash_code();
+                res.type_name = typeid(T).name();
+                res.tag = true;
+                res.count = population;
+                res.capacity = bits.capacity() * 64;
+                res.dense_bytes = bits.capacity() * sizeof(uint64_t);
+                return res;
+            }
+
+            void destroy_all(Ecs* ecs) override {
+                if (ecs == nullptr)
+                    return;
+
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{mutex};
+                this->check_structural_change_allowed();
+                bits.clear();
+                population = 0;
+            }
+        };
+
+        // Finding a bucket doesn't lock the world, only creating one does
+        template<typename T>
+        ComponentBucket<T>& get_bucket() {
+            const auto c = buckets.find(TypeID<T>{});
+            if (c == nullptr)
+                throw std::out_of_range("No component of this type was ever added to the ECS");
+            return *reinterpret_cast<ComponentBucket<T>*>(c);
+        }
+        template<typename T>
+        const ComponentBucket<T>& get_bucket() const {
+            const auto c = buckets.find(TypeID<T>{});
+            if (c == nullptr)
+                throw std::out_of_range("No component of this type was ever added to the ECS");
+            return *reinterpret_cast<const ComponentBucket<T>*>(c);
+        }
+
+        template<typename T>
+        ComponentBucket<T>* try_get_bucket() {
+            return reinterpret_cast<ComponentBucket<T>*>(buckets.find(TypeID<T>{}));
+        }
+        template<typename T>
+        const ComponentBucket<T>* try_get_bucket() const {
+            return reinterpret_cast<const ComponentBucket<T>*>(buckets.find(TypeID<T>{}));
+        }
+
+        const Container* try_get_container(const size_t type_id) const {
+            return buckets.find(type_id);
+        }
+
+        template<typename T>
+        ComponentBucket<T>& create_bucket() {
+            std::unique_lock lock{mutex};
+            const auto c = new ComponentBucket<T>{};
+            c->tick = tick;
+            buckets.add(TypeID<T>{}, c);
+            return *c;
+        }
+        template<typename T>
+        ComponentBucket<T>& get_or_create_bucket() {
+            if (const auto c = buckets.find(TypeID<T>{}); c != nullptr)
+                return *reinterpret_cast<ComponentBucket<T>*>(c);
+
+            // Another thread might have created it between the lookup and taking the lock
+            std::unique_lock lock{mutex};
+            if (const auto c = buckets.find(TypeID<T>{}); c != nullptr)
+                return *reinterpret_cast<ComponentBucket<T>*>(c);
+            return create_bucket<T>();
+        }
+
+        // Type-erased operations on one component type, so archetypes can move and destroy rows without knowing their types
+        struct ArchetypeColumn {
+            size_t type_id = 0;
+            size_t size = 0;
+            size_t align = 0;
+            void (*move_construct)(void* dst, void* src) = nullptr;
+            void (*destroy)(void* ptr) = nullptr;
+            void (*on_construct)(Ecs* ecs, void* ptr, const Entity e) = nullptr;
+            void (*on_destroy)(Ecs* ecs, void* ptr, const Entity e) = nullptr;
+
+            template<typename T>
+            static const ArchetypeColumn* of() {
+                static const ArchetypeColumn column = [] {
+                    static_assert(std::is_move_constructible_v<T>, "Archetype components must be move constructible");
+                    ArchetypeColumn res{};
+                    res.type_id = TypeID<T>{};
+                    res.size = sizeof(T);
+                    res.align = alignof(T);
+                    res.move_construct = [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); };
+                    res.destroy = [](void* ptr) { static_cast<T*>(ptr)->~T(); };
+                    if constexpr (HAS_CONSTRUCT)
+                        res.on_construct = [](Ecs* ecs, void* ptr, const Entity e) { static_cast<T*>(ptr)->on_construct(ecs, e); };
+                    if constexpr (HAS_DESTROY)
+                        res.on_destroy = [](Ecs* ecs, void* ptr, const Entity e) { static_cast<T*>(ptr)->on_destroy(ecs, e); };
+                    return res;
+                }();
+                return &column;
+            }
+        };
+
+        // Opt-in storage where all entities with the same set of components share fixed-size chunks
+        // Each chunk holds one tightly packed array per component type (SoA), so queries walk memory linearly
+        class ArchetypeStorage {
+            friend class MGMecs<EntityType, Policy>;
+
+            static constexpr size_t chunk_bytes = 16 * 1024;
+            static constexpr size_t chunk_align = 64;
+
+            struct ChunkDeleter {
+                void operator()(std::byte* ptr) const { ::operator delete(ptr, std::align_val_t{chunk_align}); }
+            };
+
+            struct Chunk {
+                std::unique_ptr<std::byte, ChunkDeleter> data{};
+                size_t count = 0;
+            };
+
+            struct Archetype {
+                std::vector<const ArchetypeColumn*> columns{};
+                std::vector<size_t> offsets{};
+                size_t capacity = 0;
+                size_t bytes = 0;
+                size_t count = 0;
+                std::vector<Chunk> chunks{};
+
+                std::unordered_map<size_t, size_t> add_edges{};
+                std::unordered_map<size_t, size_t> remove_edges{};
+
+                size_t column_index(const size_t type_id) const {
+                    for (size_t i = 0; i < columns.size(); ++i)
+                        if (columns[i]->type_id == type_id)
+                            return i;
+                    return static_cast<size_t>(-1);
+                }
+
+                Entity* entities(const size_t chunk) {
+                    return reinterpret_cast<Entity*>(chunks[chunk].data.get());
+                }
+                void* column_data(const size_t chunk, const size_t column) {
+                    return chunks[chunk].data.get() + offsets[column];
+                }
+                void* at(const size_t chunk, const size_t column, const size_t row) {
+                    return static_cast<std::byte*>(column_data(chunk, column)) + row * columns[column]->size;
+                }
+            };
+
+            struct Record {
+                uint32_t archetype = 0;
+                uint32_t chunk = 0;
+                uint32_t row = 0;
+
+                static Record none() { return {static_cast<uint32_t>(-1), 0, 0}; }
+                bool is_none() const { return archetype == static_cast<uint32_t>(-1); }
+            };
+
+            mutable RecursiveMutex mutex{};
+            std::vector<std::unique_ptr<Archetype>> archetypes{};
+            std::unordered_map<std::string, size_t> signatures{};
+            SparsePages<Record> records{};
+            size_t iterating = 0;
+
+            void add_stats(Stats& stats) const {
+                std::unique_lock lock{mutex};
+                stats.archetypes += archetypes.size();
+                stats.archetype_bytes += map_bytes(signatures) + records.bytes();
+                for (const auto& arch : archetypes) {
+                    stats.archetype_entities += arch->count;
+                    stats.archetype_bytes += arch->chunks.size() * arch->bytes + map_bytes(arch->add_edges) + map_bytes(arch->remove_edges);
+                }
+            }
+
+            static std::string signature_key(const std::vector<const ArchetypeColumn*>& columns) {
+                std::string key(columns.size() * sizeof(size_t), '\0');
+                for (size_t i = 0; i < columns.size(); ++i)
+                    std::memcpy(key.data() + i * sizeof(size_t), &columns[i]->type_id, sizeof(size_t));
+                return key;
+            }
+
+            size_t get_or_create_archetype(std::vector<const ArchetypeColumn*> columns) {
+                std::sort(columns.begin(), columns.end(), [](const auto* a, const auto* b) { return a->type_id < b->type_id; });
+                if (std::adjacent_find(columns.begin(), columns.end()) != columns.end())
+                    throw std::runtime_error("The same component type was given twice for one archetype");
+
+                const auto key = signature_key(columns);
+                const auto it = signatures.find(key);
+                if (it != signatures.end())
+                    return it->second;
+
+                auto arch = std::make_unique<Archetype>();
+                arch->columns = std::move(columns);
+
+                size_t row_bytes = sizeof(Entity);
+                for (const auto* column : arch->columns) {
+                    if (column->align > chunk_align)
+                        throw std::runtime_error("Component alignment is too large for archetype storage");
+                    row_bytes += column->size;
+                }
+                arch->capacity = std::max<size_t>(chunk_bytes / row_bytes, 1);
+
+                const auto align_up = [](size_t val, size_t align) { return (val + align - 1) / align * align; };
+                size_t offset = sizeof(Entity) * arch->capacity;
+                for (const auto* column : arch->columns) {
+                    offset = align_up(offset, column->align);
+                    arch->offsets.emplace_back(offset);
+                    offset += column->size * arch->capacity;
+                }
+                arch->bytes = align_up(offset, chunk_align);
+
+                archetypes.emplace_back(std::move(arch));
+                signatures.emplace(key, archetypes.size() - 1);
+                return archetypes.size() - 1;
+            }
+
+            size_t get_archetype_with(const size_t from, const ArchetypeColumn* column) {
+                const auto it = archetypes[from]->add_edges.find(column->type_id);
+                if (it != archetypes[from]->add_edges.end())
+                    return it->second;
+                auto columns = archetypes[from]->columns;
+                columns.emplace_back(column);
+                const auto res = get_or_create_archetype(std::move(columns));
+                archetypes[from]->add_edges.emplace(column->type_id, res);
+                return res;
+            }
+            size_t get_archetype_without(const size_t from, const size_t type_id) {
+                const auto it = archetypes[from]->remove_edges.find(type_id);
+                if (it != archetypes[from]->remove_edges.end())
+                    return it->second;
+                auto columns = archetypes[from]->columns;
+                columns.erase(columns.begin() + static_cast<std::ptrdiff_t>(archetypes[from]->column_index(type_id)));
+                const auto res = get_or_create_archetype(std::move(columns));
+                archetypes[from]->remove_edges.emplace(type_id, res);
+                return res;
+            }
+
+            Record push_row(const size_t archetype, const Entity e) {
+                auto& arch = *archetypes[archetype];
+                if (arch.chunks.empty() || arch.chunks.back().count == arch.capacity) {
+                    auto& chunk = arch.chunks.emplace_back();
+                    chunk.data.reset(static_cast<std::byte*>(::operator new(arch.bytes, std::align_val_t{chunk_align})));
+                }
+                const auto chunk = arch.chunks.size() - 1;
+                const auto row = arch.chunks.back().count++;
+                arch.entities(chunk)[row] = e;
+                ++arch.count;
+
+                const Record rec{static_cast<uint32_t>(archetype), static_cast<uint32_t>(chunk), static_cast<uint32_t>(row)};
+                records.emplace(e, rec);
+                return rec;
+            }
+
+            // Fills the hole left by a row with the last row of the archetype, destroying whatever is left in the hole
+            void pop_row(const Record rec) {
+                auto& arch = *archetypes[rec.archetype];
+                const auto last_chunk = arch.chunks.size() - 1;
+                const auto last_row = arch.chunks.back().count - 1;
+
+                for (size_t c = 0; c < arch.columns.size(); ++c)
+                    arch.columns[c]->destroy(arch.at(rec.chunk, c, rec.row));
+
+                if (rec.chunk != last_chunk || rec.row != last_row) {
+                    for (size_t c = 0; c < arch.columns.size(); ++c) {
+                        void* last = arch.at(last_chunk, c, last_row);
+                        arch.columns[c]->move_construct(arch.at(rec.chunk, c, rec.row), last);
+                        arch.columns[c]->destroy(last);
+                    }
+                    const auto moved = arch.entities(last_chunk)[last_row];
+                    arch.entities(rec.chunk)[rec.row] = moved;
+                    records.emplace(moved, rec);
+                }
+
+                if (--arch.chunks.back().count == 0)
+                    arch.chunks.pop_back();
+                --arch.count;
+            }
+
+            // Moves the entity into another archetype, keeping the components both archetypes share
+            Record migrate(const Entity e, const Record from, const size_t to) {
+                auto& src = *archetypes[from.archetype];
+                const auto rec = push_row(to, e);
+                auto& dst = *archetypes[to];
+
+                for (size_t c = 0; c < src.columns.size(); ++c) {
+                    const auto dst_c = dst.column_index(src.columns[c]->type_id);
+                    if (dst_c != static_cast<size_t>(-1))
+                        src.columns[c]->move_construct(dst.at(rec.chunk, dst_c, rec.row), src.at(from.chunk, c, from.row));
+                }
+                pop_row(from);
+                return rec;
+            }
+
+            // Same as records.find, but ignores stale handles whose index was recycled by a newer entity
+            const Record* find_record(const Entity e) const {
+                const auto* found = records.find(e);
+                if (found == nullptr || archetypes[found->archetype]->entities(found->chunk)[found->row] != e)
+                    return nullptr;
+                return found;
+            }
+            Record* find_record(const Entity e) {
+                return const_cast<Record*>(const_cast<const ArchetypeStorage*>(this)->find_record(e));
+            }
+
+            void check_not_iterating() const {
+                if (iterating != 0)
+                    throw std::runtime_error("Structural changes to archetype storage are not allowed while iterating it");
+            }
+
+          public:
+            template<typename... Ts>
+            Record create(Ecs* ecs, const Entity e, Ts&&... components) {
+                std::unique_lock lock{mutex};
+                check_not_iterating();
+                if (records.contains(e))
+                    throw std::runtime_error("Entity is already stored in an archetype");
+
+                const auto archetype = get_or_create_archetype({ArchetypeColumn::template of<std::decay_t<Ts>>()...});
+                const auto rec = push_row(archetype, e);
+                auto& arch = *archetypes[archetype];
+                (new (arch.at(rec.chunk, arch.column_index(TypeID<std::decay_t<Ts>>{}), rec.row)) std::decay_t<Ts>(std::forward<Ts>(components)), ...);
+
+                if (ecs != nullptr)
+                    for (size_t c = 0; c < arch.columns.size(); ++c)
+                        if (arch.columns[c]->on_construct)
+                            arch.columns[c]->on_construct(ecs, arch.at(rec.chunk, c, rec.row), e);
+                return rec;
+            }
+
+            template<typename T, typename... Ts>
+            T& emplace(Ecs* ecs, const Entity e, Ts&&... args) {
+                std::unique_lock lock{mutex};
+                check_not_iterating();
+
+                const auto* column = ArchetypeColumn::template of<T>();
+                const auto* found = find_record(e);
+                if (found == nullptr) {
+                    const auto rec = create(nullptr, e, T(std::forward<Ts>(args)...));
+                    T& component = *static_cast<T*>(archetypes[rec.archetype]->at(rec.chunk, 0, rec.row));
+                    if constexpr (HAS_CONSTRUCT)
+                        if (ecs != nullptr)
+                            component.on_construct(ecs, e);
+                    return component;
+                }
+                if (archetypes[found->archetype]->column_index(column->type_id) != static_cast<size_t>(-1))
+                    throw std::runtime_error("Entity already contains a component of this type");
+
+                const auto rec = migrate(e, *found, get_archetype_with(found->archetype, column));
+                auto& arch = *archetypes[rec.archetype];
+                T& component = *new (arch.at(rec.chunk, arch.column_index(column->type_id), rec.row)) T(std::forward<Ts>(args)...);
+                if constexpr (HAS_CONSTRUCT)
+                    if (ecs != nullptr)
+                        component.on_construct(ecs, e);
+                return component;
+            }
+
+            template<typename T>
+            bool try_remove(Ecs* ecs, const Entity e) {
+                std::unique_lock lock{mutex};
+                check_not_iterating();
+
+                const auto type_id = TypeID<T>{};
+                auto* found = find_record(e);
+                if (found == nullptr)
+                    return false;
+                auto column = archetypes[found->archetype]->column_index(type_id);
+                if (column == static_cast<size_t>(-1))
+                    return false;
+
+                if constexpr (HAS_DESTROY) {
+                    if (ecs != nullptr)
+                        static_cast<T*>(archetypes[found->archetype]->at(found->chunk, column, found->row))->on_destroy(ecs, e);
+                    // The hook may have restructured the storage, so look the entity up again
+                    found = find_record(e);
+                    if (found == nullptr)
+                        return true;
+                    column = archetypes[found->archetype]->column_index(type_id);
+                    if (column == static_cast<size_t>(-1))
+                        return true;
+                }
+
+                if (archetypes[found->archetype]->columns.size() == 1) {
+                    const auto rec = *found;
+                    records.erase(e);
+                    pop_row(rec);
+                    return true;
+                }
+                migrate(e, *found, get_archetype_without(found->archetype, type_id));
+                return true;
+            }
+
+            bool try_destroy(Ecs* ecs, const Entity e) {
+                std::unique_lock lock{mutex};
+                check_not_iterating();
+
+                const auto* found = find_record(e);
+                if (found == nullptr)
+                    return false;
+
+                if (ecs != nullptr) {
+                    const auto rec = *found;
+                    auto& arch = *archetypes[rec.archetype];
+                    for (size_t c = 0; c < arch.columns.size(); ++c)
+                        if (arch.columns[c]->on_destroy)
+                            arch.columns[c]->on_destroy(ecs, arch.at(rec.chunk, c, rec.row), e);
+                    found = find_record(e);
+                    if (found == nullptr)
+                        return true;
+                }
+
+                const auto rec = *found;
+                records.erase(e);
+                pop_row(rec);
+                return true;
+            }
+
+            void destroy_all(Ecs* ecs) {
+                std::unique_lock lock{mutex};
+                for (auto& arch : archetypes)
+                    while (arch->count != 0)
+                        try_destroy(ecs, arch->entities(arch->chunks.size() - 1)[arch->chunks.back().count - 1]);
+            }
+
+            template<typename T>
+            const T* try_get(const Entity e) const {
+                std::unique_lock lock{mutex};
+                const auto* found = find_record(e);
+                if (found == nullptr)
+                    return nullptr;
+                auto& arch = *archetypes[found->archetype];
+                const auto column = arch.column_index(TypeID<T>{});
+                if (column == static_cast<size_t>(-1))
+                    return nullptr;
+                return static_cast<const T*>(arch.at(found->chunk, column, found->row));
+            }
+            template<typename T>
+            T* try_get(const Entity e) {
+                return const_cast<T*>(const_cast<const ArchetypeStorage*>(this)->template try_get<T>(e));
+            }
+
+            bool contains(const Entity e) const {
+                std::unique_lock lock{mutex};
+                return find_record(e) != nullptr;
+            }
+
+          private:
+            template<typename Fn, typename... Ts, size_t... Is>
+            static void each_in_chunk(Archetype& arch, const size_t chunk, const size_t (&columns)[sizeof...(Ts)], Fn& fn, std::index_sequence<Is...>) {
+                const auto count = arch.chunks[chunk].count;
+                const Entity* entities = arch.entities(chunk);
+                const auto arrays = std::make_tuple(static_cast<Ts*>(arch.column_data(chunk, columns[Is]))...);
+                for (size_t row = 0; row < count; ++row)
+                    fn(entities[row], std::get<Is>(arrays)[row]...);
+            }
+
+          public:
+            // Calls fn(entity, Includes&...) for every entity whose archetype has all of Includes and none of Excludes
+            template<typename Fn, typename... Includes, typename... Excludes>
+            void each(Fn& fn, TypeList<Includes...>, TypeList<Excludes...>) {
+                static_assert(sizeof...(Includes) != 0, "Iterating archetypes requires at least one included component type");
+                std::unique_lock lock{mutex};
+                ++iterating;
+                try {
+                    for (auto& arch : archetypes) {
+                        if (arch->count == 0)
+                            continue;
+                        if ((... || (arch->column_index(TypeID<std::remove_const_t<Excludes>>{}) != static_cast<size_t>(-1))))
+                            continue;
+
+                        const size_t columns[sizeof...(Includes)]{arch->column_index(TypeID<std::remove_const_t<Includes>>{})...};
+                        if (std::find(std::begin(columns), std::end(columns), static_cast<size_t>(-1)) != std::end(columns))
+                            continue;
+
+                        for (size_t chunk = 0; chunk < arch->chunks.size(); ++chunk)
+                            each_in_chunk<Fn, Includes...>(*arch, chunk, columns, fn, std::index_sequence_for<Includes...>{});
+                    }
+                }
+                catch (...) {
+                    --iterating;
+                    throw;
+                }
+                --iterating;
+            }
+        };
+
+        // Live slots hold the handle of the entity using them. Free slots form an intrusive list, where the index bits point to the
+        // next free slot and the version bits hold the version the slot will be handed out with
+        class EntityManager {
+            std::vector<Entity> slots{};
+            EntityType free_head = entity_index_mask;
+            size_t alive = 0;
+
+          public:
+            EntityManager() = default;
+            EntityManager(const EntityManager&) = default;
+            EntityManager(EntityManager&&) = default;
+            EntityManager& operator=(const EntityManager&) = default;
+            EntityManager& operator=(EntityManager&&) = default;
+
+            Entity create() {
+                if (free_head == entity_index_mask) {
+                    // The last index is reserved, so null never refers to a live entity
+                    if (slots.size() >= static_cast<size_t>(entity_index_mask))
+                        throw std::runtime_error("Ran out of entity indices");
+                    ++alive;
+                    return slots.emplace_back(Entity::from_parts(static_cast<EntityType>(slots.size()), 0));
+                }
+
+                const auto index = free_head;
+                auto& slot = slots[index];
+                free_head = slot.index();
+                slot = Entity::from_parts(index, slot.version());
+                ++alive;
+                return slot;
+            }
+
+            bool valid(const Entity id) const {
+                const auto index = static_cast<size_t>(id.index());
+                return index < slots.size() && slots[index] == id;
+            }
+
+            void destroy(const Entity id) {
+                if (!try_destroy(id))
+                    throw std::runtime_error("Entity was never created, or was already destroyed");
+            }
+            bool try_destroy(const Entity id) {
+                if (!valid(id))
+                    return false;
+                slots[id.index()] = Entity::from_parts(free_head, static_cast<EntityType>(id.version() + 1));
+                free_head = id.index();
+                --alive;
+                return true;
+            }
+
+            // Makes room for n more entities than there are recycled indices to hand out
+            void reserve(const size_t n) { slots.reserve(slots.size() + n); }
+
+            size_t count() const { return alive; }
+            // Indices handed out so far, alive or waiting to be recycled
+            size_t index_count() const { return slots.size(); }
+            size_t bytes() const { return slots.capacity() * sizeof(Entity); }
+
+            ~EntityManager() = default;
+        };
+
+        // Maps type IDs to their buckets through a fixed directory of lazily allocated pages. Type IDs are a dense counter, so
+        // finding a bucket is two array indexes. Pages and slots are never freed or reused while the world is alive, so finding
+        // a bucket doesn't lock anything, only adding one has to hold the world mutex
+        class BucketRegistry {
+            static constexpr size_t page_size = 64;
+            static constexpr size_t max_pages = 1024;
+
+            struct Page {
+                std::array<std::atomic<Container*>, page_size> slots{};
+            };
+
+            std::unique_ptr<std::atomic<Page*>[]> pages = std::make_unique<std::atomic<Page*>[]>(max_pages);
+            // In the order the buckets were added, for the passes which have to visit all of them
+            std::vector<std::pair<size_t, Container*>> registered{};
+
+          public:
+            BucketRegistry() = default;
+            BucketRegistry(const BucketRegistry&) = delete;
+            BucketRegistry& operator=(const BucketRegistry&) = delete;
+
+            Container* find(const size_t type_id) const {
+                if (type_id >= page_size * max_pages)
+                    return nullptr;
+                const auto page = pages[type_id / page_size].load(std::memory_order_acquire);
+                if (page == nullptr)
+                    return nullptr;
+                return page->slots[type_id % page_size].load(std::memory_order_acquire);
+            }
+
+            // The caller must hold the world mutex
+            void add(const size_t type_id, Container* c) {
+                if (type_id >= page_size * max_pages)
+                    throw std::length_error("Too many component types registered in the ECS");
+                auto& page_ptr = pages[type_id / page_size];
+                auto page = page_ptr.load(std::memory_order_relaxed);
+                if (page == nullptr) {
+                    page = new Page{};
+                    page_ptr.store(page, std::memory_order_release);
+                }
+                registered.emplace_back(type_id, c);
+                page->slots[type_id % page_size].store(c, std::memory_order_release);
+            }
+
+            // Hands all buckets to the other registry, and takes its (empty or orphaned) ones in exchange
+            void swap(BucketRegistry& other) {
+                std::swap(pages, other.pages);
+                std::swap(registered, other.registered);
+            }
+
+            auto begin() { return registered.begin(); }
+            auto end() { return registered.end(); }
+            auto begin() const { return registered.begin(); }
+            auto end() const { return registered.end(); }
+            bool empty() const { return registered.empty(); }
+
+            // Removes the most recently added bucket from the registry, and returns it, without deleting it
+            Container* pop() {
+                const auto [type_id, c] = registered.back();
+                registered.pop_back();
+                pages[type_id / page_size].load(std::memory_order_relaxed)->slots[type_id % page_size].store(nullptr, std::memory_order_release);
+                return c;
+            }
+
+            ~BucketRegistry() {
+                if (pages == nullptr)
+                    return;
+                for (size_t i = 0; i < max_pages; ++i)
+                    delete pages[i].load(std::memory_order_relaxed);
+            }
+        };
+
+        EntityManager entities{};
+        BucketRegistry buckets{};
+        uint64_t tick = 1;
+        std::unique_ptr<ArchetypeStorage> archetype_storage = std::make_unique<ArchetypeStorage>();
+        EntityLockTable locks{};
+
+      public:
+        MGMecs() = default;
+        MGMecs(const MGMecs&) = delete;
+        MGMecs(MGMecs&& other) noexcept {
+            if (this == &other)
+                return;
+
+            std::unique_lock lock{mutex};
+            std::unique_lock other_lock{other.mutex};
 
             for (const auto& g : other.groups)
                 g->ecs_moved(this);
             for (const auto& l : other.s_locks)
-                l.ecs = this;
+                l->ecs = this;
 
             groups = std::move(other.groups);
             entities = std::move(other.entities);
-            buckets = std::move(other.buckets);
-            locks = std::move(other.locks);
+            buckets.swap(other.buckets);
+            tick = other.tick;
+            owning_groups = std::move(other.owning_groups);
+            archetype_storage = std::move(other.archetype_storage);
+            locks.move_from(other.locks);
             s_locks = std::move(other.s_locks);
 
+            std::unique_lock buffers_lock{other.command_buffers_mutex};
+            for (auto& buffer : other.command_buffers)
+                buffer->ecs = this;
+            command_buffers = std::move(other.command_buffers);
+            thread_command_buffers = std::move(other.thread_command_buffers);
+        }
+        MGMecs& operator=(const MGMecs&) = delete;
+        MGMecs& operator=(MGMecs&& other) noexcept {
+            if (this == &other)
+                return *this;
+
+            std::unique_lock lock{mutex};
+            std::unique_lock other_lock{other.mutex};
+
+            for (const auto& g : other.groups)
+                g->ecs_moved(this);
+            for (const auto& l : other.s_locks)
+                l->ecs = this;
+
+            groups = std::move(other.groups);
+            entities = std::move(other.entities);
+            buckets.swap(other.buckets);
+            tick = other.tick;
+            owning_groups = std::move(other.owning_groups);
+            archetype_storage = std::move(other.archetype_storage);
+            locks.move_from(other.locks);
+            s_locks = std::move(other.s_locks);
+
+            std::unique_lock buffers_lock{other.command_buffers_mutex};
+            for (auto& buffer : other.command_buffers)
+                buffer->ecs = this;
+            command_buffers = std::move(other.command_buffers);
+            thread_command_buffers = std::move(other.thread_command_buffers);
+
             return *this;
         }
 
@@ -1257,44 +3196,131 @@ namespace mgm {
                 *it = entities.create();
         }
 
+        // Creates count entities which each get a copy of every prototype component
+        // Every bucket grows once for the whole batch, and the construct hooks run after all components of a type were created
+        template<typename... Ts>
+        std::vector<Entity> create_many(const size_t count, const Ts&... prototype) {
+            static_assert((... && std::is_copy_constructible_v<Ts>), "Prototype components must be copy constructible");
+            std::vector<Entity> res(count);
+            {
+                std::unique_lock lock{mutex};
+                entities.reserve(count);
+                for (auto& e : res)
+                    e = entities.create();
+            }
+            // The prototypes are copied first, in case they live in the buckets that are about to grow
+            const std::tuple<Ts...> prototypes{prototype...};
+            std::apply([&](const auto&... p) { (get_or_create_bucket<std::decay_t<decltype(p)>>().try_create(this, res.begin(), res.end(), p), ...); }, prototypes);
+            return res;
+        }
+
+        // Creates count entities with copies of all of the prototype entity's components, in the same way as create_many
+        // Components stored in archetypes are not cloned
+        std::vector<Entity> clone(const Entity prototype, const size_t count) {
+            std::vector<Entity> res(count);
+            std::vector<Container*> containers{};
+            {
+                std::unique_lock lock{mutex};
+                if (!entities.valid(prototype))
+                    throw std::runtime_error("Cannot clone an entity that is not alive");
+                entities.reserve(count);
+                for (auto& e : res)
+                    e = entities.create();
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(bucket);
+            }
+            // Construct hooks may need the world mutex, so the buckets are filled after letting go of it
+            for (const auto bucket : containers)
+                bucket->clone(this, prototype, res);
+            return res;
+        }
+
         template<typename T, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
         T& emplace(const Entity e, Ts&&... args) {
+            if (!valid(e))
+                throw std::runtime_error("Cannot add a component to an entity that is not alive");
             auto& bucket = get_or_create_bucket<T>();
             return bucket.create(this, e, std::forward<Ts>(args)...);
         }
         template<typename T, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
         T& get_or_emplace(const Entity e, Ts&&... args) {
+            if (!valid(e))
+                throw std::runtime_error("Cannot add a component to an entity that is not alive");
             auto& bucket = get_or_create_bucket<T>();
             return bucket.get_or_create(this, e, std::forward<Ts>(args)...);
         }
 
         template<typename T, typename It, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
         void emplace(const It& begin, const It& end, Ts&&... args) {
+            for (auto it = begin; it != end; ++it)
+                if (!valid(*it))
+                    throw std::runtime_error("Cannot add a component to an entity that is not alive");
             auto& bucket = get_or_create_bucket<T>();
             if (!bucket.try_create(this, begin, end, std::forward<Ts>(args)...))
                 throw std::runtime_error("Could not emplace a component on one of the entities");
         }
         template<typename T, typename It, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
         void try_emplace(const It& begin, const It& end, Ts&&... args) {
+            std::vector<Entity> alive{};
+            for (auto it = begin; it != end; ++it)
+                if (valid(*it))
+                    alive.emplace_back(*it);
+            auto& bucket = get_or_create_bucket<T>();
+            bucket.try_create(this, alive.begin(), alive.end(), std::forward<Ts>(args)...);
+        }
+
+        // Adds a component to every entity in [begin, end) in one batch, the i-th one being move constructed from values[i]
+        // Entities which already have the component are skipped, along with their value
+        template<typename T, typename It, typename VIt>
+        void emplace_each(const It& begin, const It& end, const VIt& values) {
+            static_assert(!is_tag<T>, "Every entity with a tag shares the same instance of it");
+            static_assert(std::is_move_constructible_v<T>, "Components are move constructed from the values");
+            for (auto it = begin; it != end; ++it)
+                if (!valid(*it))
+                    throw std::runtime_error("Cannot add a component to an entity that is not alive");
             auto& bucket = get_or_create_bucket<T>();
-            bucket.try_create(this, begin, end, std::forward<Ts>(args)...);
+            if (!bucket.try_create_each(this, begin, end, values))
+                throw std::runtime_error("Could not emplace a component on one of the entities");
         }
 
+      private:
+        // Tag buckets only know entity indices, so a handle to a destroyed entity would see the tags of the entity reusing its index
+        template<typename T>
+        bool reaches_bucket(const Entity e) const {
+            if constexpr (ComponentBucket<T>::tag_storage)
+                return valid(e);
+            else
+                return true;
+        }
+        template<typename T, typename It>
+        std::vector<Entity> reaching_bucket(const It& begin, const It& end) const {
+            std::vector<Entity> res{};
+            for (auto it = begin; it != end; ++it)
+                if (reaches_bucket<T>(*it))
+                    res.emplace_back(*it);
+            return res;
+        }
+
+      public:
         template<typename T>
         T& get(const Entity e) {
             auto& bucket = get_bucket<T>();
+            if (!reaches_bucket<T>(e))
+                throw std::out_of_range("Entity does not contain a component of this type");
             return bucket.get(e);
         }
         template<typename T>
         const T& get(const Entity e) const {
             const auto& bucket = get_bucket<T>();
+            if (!reaches_bucket<T>(e))
+                throw std::out_of_range("Entity does not contain a component of this type");
             return bucket.get(e);
         }
 
         template<typename T>
         T* try_get(const Entity e) {
             auto* bucket = try_get_bucket<T>();
-            if (bucket == nullptr)
+            if (bucket == nullptr || !reaches_bucket<T>(e))
                 return nullptr;
 
             return bucket->try_get(e);
@@ -1302,7 +3328,7 @@ namespace mgm {
         template<typename T>
         const T* try_get(const Entity e) const {
             const auto* bucket = try_get_bucket<T>();
-            if (bucket == nullptr)
+            if (bucket == nullptr || !reaches_bucket<T>(e))
                 return nullptr;
             return bucket->try_get(e);
         }
@@ -1312,6 +3338,25 @@ namespace mgm {
             return try_get<T>(e) != nullptr;
         }
 
+        // Type IDs (see TypeID) of all component types the entity has, in the order their buckets were created
+        // Components stored in archetypes are not included
+        std::vector<size_t> component_types(const Entity e) const {
+            std::vector<std::pair<size_t, const Container*>> containers{};
+            {
+                std::unique_lock lock{mutex};
+                if (!entities.valid(e))
+                    return {};
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(type, bucket);
+            }
+
+            std::vector<size_t> res{};
+            for (const auto& [type, bucket] : containers)
+                if (bucket->has(e))
+                    res.emplace_back(type);
+            return res;
+        }
+
         template<typename T, typename It>
         bool contains(const It& begin, const It& end) {
             const auto* bucket = try_get_bucket<T>();
@@ -1319,130 +3364,570 @@ namespace mgm {
                 return false;
             bool does_contain = true;
             for (auto it = begin; it != end && does_contain; ++it)
-                does_contain = does_contain && (bucket->try_get(*it) != nullptr);
+                does_contain = does_contain && reaches_bucket<T>(*it) && (bucket->try_get(*it) != nullptr);
             return does_contain;
         }
 
         template<typename T>
         void remove(const Entity e) {
             auto& bucket = get_bucket<T>();
-            locks.wait_and_lock(e);
+            if (!reaches_bucket<T>(e))
+                throw std::runtime_error("Could not remove component from entity");
+            const HeldEntityLock held{locks, e};
             if (!bucket.try_destroy(this, e))
                 throw std::runtime_error("Could not remove component from entity");
-            locks.unlock(e);
         }
         template<typename T>
         void try_remove(const Entity e) {
             auto* bucket = try_get_bucket<T>();
-            if (bucket == nullptr)
+            if (bucket == nullptr || !reaches_bucket<T>(e))
                 return;
 
-            locks.wait_and_lock(e);
+            const HeldEntityLock held{locks, e};
             bucket->try_destroy(this, e);
-            locks.unlock(e);
         }
 
         template<typename T, typename It>
         void remove(const It& begin, const It& end) {
             auto& bucket = get_bucket<T>();
-            locks.wait_and_lock(begin, end);
-            bucket.try_destroy(this, begin, end);
-            locks.unlock(begin, end);
+            const HeldEntityLocks held{locks, begin, end};
+            if constexpr (ComponentBucket<T>::tag_storage) {
+                const auto alive = reaching_bucket<T>(begin, end);
+                bucket.try_destroy(this, alive.begin(), alive.end());
+            }
+            else
+                bucket.try_destroy(this, begin, end);
         }
         template<typename T, typename It>
         void try_remove(const It& begin, const It& end) {
             auto* bucket = try_get_bucket<T>();
             if (bucket == nullptr)
                 return;
-            locks.wait_and_lock(begin, end);
-            bucket->try_destroy(this, begin, end);
-            locks.unlock(begin, end);
+            const HeldEntityLocks held{locks, begin, end};
+            if constexpr (ComponentBucket<T>::tag_storage) {
+                const auto alive = reaching_bucket<T>(begin, end);
+                bucket->try_destroy(this, alive.begin(), alive.end());
+            }
+            else
+                bucket->try_destroy(this, begin, end);
         }
 
+        // The entity stays valid while the on_destroy hooks of its components run, and its slot is only recycled afterwards
+        // Its components are destroyed after letting go of the world mutex, since an owning group locks all of its buckets while
+        // an entity leaves it, and iterators lock their bucket before the world
         void destroy(const Entity e) {
-            locks.wait_and_lock(e);
+            if (!try_destroy(e))
+                throw std::runtime_error("Entity was never created, or was already destroyed");
+        }
+        bool try_destroy(const Entity e) {
+            const HeldEntityLock held{locks, e};
 
-            std::unique_lock lock{mutex};
-            entities.destroy(e);
+            std::vector<Container*> containers{};
+            {
+                std::unique_lock lock{mutex};
+                if (!entities.valid(e))
+                    return false;
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(bucket);
+            }
 
-            for (auto& [type, bucket] : buckets)
+            archetype_storage->try_destroy(this, e);
+            for (const auto bucket : containers)
                 bucket->try_destroy(this, e);
 
-            locks.unlock(e);
-        }
-        void try_destroy(const Entity e) {
             std::unique_lock lock{mutex};
-            locks.wait_and_lock(e);
+            entities.try_destroy(e);
+            return true;
+        }
 
-            if (!entities.try_destroy(e))
+        template<typename It>
+        void destroy(const It& begin, const It& end) {
+            if (std::distance(begin, end) == 0)
                 return;
 
-            for (auto& [type, bucket] : buckets)
-                bucket->try_destroy(this, e);
+            const HeldEntityLocks held{locks, begin, end};
 
-            locks.unlock(e);
-        }
+            std::vector<Container*> containers{};
+            {
+                std::unique_lock lock{mutex};
+                for (auto it = begin; it != end; ++it)
+                    if (!entities.valid(*it))
+                        throw std::runtime_error("Entity was never created, or was already destroyed");
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(bucket);
+            }
 
+            destroy_held(begin, end, containers);
+        }
         template<typename It>
-        void destroy(const It& begin, const It& end) {
-            const auto dist = std::distance(begin, end);
-            if (dist == 0)
-                return;
+        void try_destroy(const It& begin, const It& end) {
+            const HeldEntityLocks held{locks, begin, end};
 
-            std::unique_lock lock{mutex};
+            std::vector<Entity> alive{};
+            std::vector<Container*> containers{};
+            {
+                std::unique_lock lock{mutex};
+                for (auto it = begin; it != end; ++it)
+                    if (entities.valid(*it))
+                        alive.emplace_back(*it);
+                if (alive.empty())
+                    return;
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(bucket);
+            }
 
-            locks.wait_and_lock(begin, end);
+            destroy_held(alive.begin(), alive.end(), containers);
+        }
 
+      private:
+        // Destroys the components of live entities which the calling thread locked, and then the entities, without holding
+        // the world mutex while the buckets are emptied
+        template<typename It>
+        void destroy_held(const It& begin, const It& end, const std::vector<Container*>& containers) {
             for (auto it = begin; it != end; ++it)
-                entities.destroy(*it);
-
-            for (auto& [type, bucket] : buckets)
+                archetype_storage->try_destroy(this, *it);
+            for (const auto bucket : containers)
                 bucket->try_destroy(this, GenericIteratorHelper<Entity>{begin}, GenericIteratorHelper<Entity>{end});
 
-            locks.unlock(begin, end);
+            std::unique_lock lock{mutex};
+            for (auto it = begin; it != end; ++it)
+                entities.try_destroy(*it);
         }
-        template<typename It>
-        void try_destroy(const It& begin, const It& end) {
+
+      public:
+        bool valid(const Entity e) const {
             std::unique_lock lock{mutex};
-            bool any_destroyed = false;
+            return entities.valid(e);
+        }
 
-            locks.wait_and_lock(begin, end);
+        // Records structural changes, to be applied later all at once by MGMecs::flush_commands
+        // Every thread gets its own buffer from MGMecs::commands(), so systems iterating (even in parallel) can queue up changes
+        // without touching the buckets they are iterating
+        class CommandBuffer {
+            friend class MGMecs;
 
-            for (auto it = begin; it != end; ++it)
-                if (entities.try_destroy(*it))
-                    any_destroyed = true;
+            struct PendingBase {
+                virtual ~PendingBase() = default;
+                virtual void clear() = 0;
+            };
+            template<typename T>
+            struct Pending : public PendingBase {
+                std::vector<T> values{};
+                void clear() override { values.clear(); }
+            };
+
+            enum class Kind : uint8_t {
+                EMPLACE,
+                REMOVE
+            };
+            struct Command;
+
+            // Applies one type's commands, already sorted by entity and with at most one command per entity
+            struct Ops {
+                size_t type_id = 0;
+                void (*apply)(Ecs& ecs, const Command* begin, const Command* end) = nullptr;
 
-            if (!any_destroyed) {
-                locks.unlock(begin, end);
+                template<typename T>
+                static const Ops* of() {
+                    static const Ops ops{TypeID<T>{}, &apply_commands<T>};
+                    return &ops;
+                }
+            };
+
+            struct Command {
+                Entity e{};
+                Kind kind = Kind::EMPLACE;
+                const Ops* ops = nullptr;
+                PendingBase* values = nullptr;
+                size_t index = 0;
+            };
+
+            template<typename T>
+            static void apply_commands(Ecs& ecs, const Command* begin, const Command* end) {
+                auto& bucket = ecs.get_or_create_bucket<T>();
+
+                // Grow the dense arrays once for the whole run, under the bucket's mutex and with the same checks as creating a
+                // component, since other threads may be reading the bucket, or a pass walking it, meanwhile
+                if constexpr (!ComponentBucket<T>::tag_storage) {
+                    Container::check_not_in_parallel_pass();
+                    std::unique_lock lock{bucket.mutex};
+                    bucket.check_structural_change_allowed();
+                    const auto needed = bucket.components.size() + static_cast<size_t>(end - begin);
+                    if (bucket.components.capacity() < needed) {
+                        bucket.components.reserve(std::max(needed, bucket.components.capacity() * 2));
+                        bucket.original.reserve(bucket.components.capacity());
+                        bucket.added_ticks.reserve(bucket.components.capacity());
+                        bucket.changed_ticks.reserve(bucket.components.capacity());
+                    }
+                }
+
+                for (auto it = begin; it != end; ++it) {
+                    if (it->kind == Kind::REMOVE) {
+                        ecs.try_remove<T>(it->e);
+                        continue;
+                    }
+
+                    // Taken out of the pending values first, since the hooks which run below may record more commands of
+                    // this type, and grow the vector the value is in
+                    T value = std::move(static_cast<Pending<T>*>(it->values)->values[it->index]);
+                    if (bucket.has(it->e))
+                        ecs.try_remove<T>(it->e);
+                    bucket.create(&ecs, it->e, std::move(value));
+                }
+            }
+
+            Ecs* ecs = nullptr;
+            std::vector<Command> commands{};
+            std::vector<Entity> destroyed{};
+            std::unordered_map<size_t, std::unique_ptr<PendingBase>> pending{};
+
+          public:
+            explicit CommandBuffer(Ecs& owner)
+                : ecs{&owner} {}
+
+            CommandBuffer(const CommandBuffer&) = delete;
+            CommandBuffer(CommandBuffer&&) = delete;
+            CommandBuffer& operator=(const CommandBuffer&) = delete;
+            CommandBuffer& operator=(CommandBuffer&&) = delete;
+
+            // The entity is created right away, so its handle can be used by later commands, but it has no components until the flush
+            Entity create() { return ecs->create(); }
+
+            // Adds the component at the flush, replacing the one the entity has at that point, if any
+            template<typename T, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
+            void emplace(const Entity e, Ts&&... args) {
+                auto& slot = pending[TypeID<T>{}];
+                if (slot == nullptr)
+                    slot = std::make_unique<Pending<T>>();
+                auto& values = static_cast<Pending<T>&>(*slot).values;
+                values.emplace_back(std::forward<Ts>(args)...);
+                commands.emplace_back(Command{e, Kind::EMPLACE, Ops::template of<T>(), slot.get(), values.size() - 1});
+            }
+
+            template<typename T>
+            void remove(const Entity e) {
+                commands.emplace_back(Command{e, Kind::REMOVE, Ops::template of<T>(), nullptr, 0});
+            }
+
+            void destroy(const Entity e) { destroyed.emplace_back(e); }
+
+            bool empty() const { return commands.empty() && destroyed.empty(); }
+
+            void clear() {
+                commands.clear();
+                destroyed.clear();
+                for (auto& [type, values] : pending)
+                    values->clear();
+            }
+        };
+
+      private:
+        mutable Mutex command_buffers_mutex{};
+        std::vector<std::unique_ptr<CommandBuffer>> command_buffers{};
+        std::unordered_map<std::thread::id, CommandBuffer*> thread_command_buffers{};
+
+      public:
+        // The calling thread's command buffer, which stays the same for the lifetime of the thread
+        CommandBuffer& commands() {
+            std::unique_lock lock{command_buffers_mutex};
+            auto& buffer = thread_command_buffers[std::this_thread::get_id()];
+            if (buffer == nullptr)
+                buffer = command_buffers.emplace_back(std::make_unique<CommandBuffer>(*this)).get();
+            return *buffer;
+        }
+
+        // Applies the commands recorded by every thread, and clears their buffers
+        // This is a sync point: no other thread may record commands, or iterate the world, while it runs
+        // Commands are applied grouped by component type and sorted by entity. If the same entity and type got several commands,
+        // only the last one recorded is applied, and nothing is applied to entities which get destroyed in the same flush
+        void flush_commands() {
+            using Command = typename CommandBuffer::Command;
+
+            // Commands split by component type, in recording order
+            std::vector<std::pair<const typename CommandBuffer::Ops*, std::vector<Command>>> per_type{};
+            std::vector<Entity> destroyed{};
+            {
+                // Hooks which run during the flush may record new commands, which are kept for the next flush
+                std::unique_lock lock{command_buffers_mutex};
+                for (const auto& buffer : command_buffers) {
+                    size_t current = 0;
+                    for (const auto& command : buffer->commands) {
+                        if (current == per_type.size() || per_type[current].first != command.ops) {
+                            current = 0;
+                            while (current != per_type.size() && per_type[current].first != command.ops)
+                                ++current;
+                            if (current == per_type.size())
+                                per_type.emplace_back(command.ops, std::vector<Command>{});
+                        }
+                        per_type[current].second.emplace_back(command);
+                    }
+                    destroyed.insert(destroyed.end(), buffer->destroyed.begin(), buffer->destroyed.end());
+                    buffer->commands.clear();
+                    buffer->destroyed.clear();
+                }
+            }
+            if (per_type.empty() && destroyed.empty())
                 return;
+
+            // The world is only locked while deciding what to apply. Applying takes entity locks and bucket mutexes, and
+            // everywhere else entity locks are taken before the world's mutex, never while holding it
+            std::unique_lock lock{mutex};
+
+            std::sort(destroyed.begin(), destroyed.end(), [](const Entity a, const Entity b) { return a.index() < b.index() || (a.index() == b.index() && a < b); });
+            destroyed.erase(std::unique(destroyed.begin(), destroyed.end()), destroyed.end());
+            std::vector<bool> dying{};
+            for (const auto e : destroyed) {
+                if (!entities.valid(e))
+                    continue;
+                if (dying.size() <= e.index())
+                    dying.resize(static_cast<size_t>(e.index()) + 1);
+                dying[e.index()] = true;
             }
 
-            for (auto& [type, bucket] : buckets)
-                bucket->try_destroy(this, GenericIteratorHelper<Entity>{begin}, GenericIteratorHelper<Entity>{end});
+            std::sort(per_type.begin(), per_type.end(), [](const auto& a, const auto& b) { return a.first->type_id < b.first->type_id; });
+
+            for (auto& [ops, commands] : per_type) {
+                // Stable, so the commands for one entity stay in the order they were recorded in
+                // Entities are usually recorded in order already, in which case there is nothing to sort
+                const auto by_entity = [](const Command& a, const Command& b) {
+                    if (a.e.index() != b.e.index())
+                        return a.e.index() < b.e.index();
+                    return a.e < b.e;
+                };
+                if (!std::is_sorted(commands.begin(), commands.end(), by_entity))
+                    std::stable_sort(commands.begin(), commands.end(), by_entity);
+
+                // Keep the last command for every entity, and drop the ones for entities which are destroyed anyway
+                size_t kept = 0;
+                for (size_t i = 0; i < commands.size(); ++i) {
+                    if (i + 1 != commands.size() && commands[i + 1].e == commands[i].e)
+                        continue;
+                    const auto index = static_cast<size_t>(commands[i].e.index());
+                    if (!entities.valid(commands[i].e) || (index < dying.size() && dying[index]))
+                        continue;
+                    commands[kept++] = commands[i];
+                }
+                commands.resize(kept);
+            }
+            lock.unlock();
+
+            for (const auto& [ops, commands] : per_type)
+                ops->apply(*this, commands.data(), commands.data() + commands.size());
+
+            for (const auto e : destroyed)
+                try_destroy(e);
+
+            // Pending values are referenced by index, so they can only be dropped once no command refers to them anymore
+            std::unique_lock buffers_lock{command_buffers_mutex};
+            for (auto& buffer : command_buffers)
+                if (buffer->commands.empty())
+                    for (auto& [type, values] : buffer->pending)
+                        values->clear();
+        }
+
+        // Create an entity whose components are stored together in an archetype instead of in per-type buckets
+        // Archetype components are accessed through the archetype_* functions, or iterated with Group::archetype_each
+        template<typename... Ts>
+        Entity create_archetype(Ts&&... components) {
+            std::unique_lock lock{mutex};
+            const auto e = entities.create();
+            lock.unlock();
+            archetype_storage->create(this, e, std::forward<Ts>(components)...);
+            return e;
+        }
+
+        template<typename T, typename... Ts, std::enable_if_t<std::is_constructible_v<T, Ts...>, bool> = true>
+        T& archetype_emplace(const Entity e, Ts&&... args) {
+            if (!valid(e))
+                throw std::runtime_error("Cannot add a component to an entity that is not alive");
+            return archetype_storage->template emplace<T>(this, e, std::forward<Ts>(args)...);
+        }
+
+        template<typename T>
+        T& archetype_get(const Entity e) {
+            const auto component = archetype_storage->template try_get<T>(e);
+            if (component == nullptr)
+                throw std::out_of_range("Entity does not contain an archetype component of this type");
+            return *component;
+        }
+        template<typename T>
+        const T& archetype_get(const Entity e) const {
+            const auto component = archetype_storage->template try_get<T>(e);
+            if (component == nullptr)
+                throw std::out_of_range("Entity does not contain an archetype component of this type");
+            return *component;
+        }
+
+        template<typename T>
+        T* archetype_try_get(const Entity e) {
+            return archetype_storage->template try_get<T>(e);
+        }
+        template<typename T>
+        const T* archetype_try_get(const Entity e) const {
+            return archetype_storage->template try_get<T>(e);
+        }
+
+        template<typename T>
+        void archetype_remove(const Entity e) {
+            const HeldEntityLock held{locks, e};
+            if (!archetype_storage->template try_remove<T>(this, e))
+                throw std::runtime_error("Could not remove archetype component from entity");
+        }
+        template<typename T>
+        void archetype_try_remove(const Entity e) {
+            const HeldEntityLock held{locks, e};
+            archetype_storage->template try_remove<T>(this, e);
+        }
 
-            locks.unlock(begin, end);
+        bool in_archetype(const Entity e) const {
+            return archetype_storage->contains(e);
         }
 
         template<typename T>
         Entity as_entity(const T& component) const {
+            static_assert(!is_tag<T>, "Every entity with a tag shares the same instance of it");
             const auto* bucket = try_get_bucket<T>();
             if (bucket == nullptr)
                 return null;
 
             std::unique_lock lock{bucket->mutex};
 
-            const auto* first = bucket->components.data();
-            const auto* last = first + bucket->components.size();
+            if constexpr (ComponentBucket<T>::stable_storage) {
+                const auto i = bucket->components.index_of(&component);
+                return i < bucket->original.size() ? bucket->original[i] : null;
+            }
+            else {
+                const auto* first = bucket->components.data();
+                const auto* last = first + bucket->components.size();
+
+                if (&component < first || &component >= last)
+                    return null;
 
-            if (&component < first || &component >= last)
-                return null;
+                return bucket->original[&component - first];
+            }
+        }
 
-            return bucket->original[&component - first];
+        // Components are stamped with the current tick when they are created, and every time they are accessed mutably
+        // (non-const get, try_get, get_or_emplace, or a mutable group pass), which Group::changed_since and Group::added_since
+        // filter by. A system which runs incrementally keeps the tick returned by advance_tick() after each of its runs, and only
+        // visits what changed since then on the next run
+        uint64_t current_tick() const {
+            std::unique_lock lock{mutex};
+            return tick;
+        }
+
+        // Ends the current tick, and returns the new one
+        uint64_t advance_tick() {
+            std::unique_lock lock{mutex};
+            ++tick;
+            for (auto& [type, bucket] : buckets)
+                bucket->tick.store(tick, std::memory_order_relaxed);
+            return tick;
         }
 
         EntityType entities_count() const {
             std::unique_lock lock{mutex};
-            return static_cast<EntityType>(entities.all().size());
+            return static_cast<EntityType>(entities.count());
+        }
+
+        // Collects the occupancy and memory use of the world and of every bucket, locking each of them only while it's read
+        // The byte counts are estimates for the hash maps, whose nodes the standard library doesn't expose
+        Stats stats() const {
+            Stats res{};
+            std::vector<const Container*> containers{};
+            {
+                std::unique_lock lock{mutex};
+                res.entities = entities.count();
+                res.entity_indices = entities.index_count();
+                res.entity_bytes = entities.bytes();
+                for (const auto& [type, bucket] : buckets)
+                    containers.emplace_back(bucket);
+            }
+            res.entity_locks_held = locks.held();
+            res.entity_lock_slots = locks.slot_count();
+            archetype_storage->add_stats(res);
+
+            // Buckets are never destroyed before the world, and their own locks can't be taken while holding the world's
+            res.buckets.reserve(containers.size());
+            for (const auto* bucket : containers)
+                res.buckets.emplace_back(bucket->stats());
+            return res;
+        }
+
+        // A copy of the entities and of every bucket of a world, which MGMecs::restore can roll the world back to
+        // Copies of a snapshot share the copied components, so passing one around is cheap
+        class Snapshot {
+            friend class MGMecs;
+
+            EntityManager entities{};
+            uint64_t tick = 1;
+            std::vector<BucketImage> buckets{};
+
+          public:
+            Snapshot() = default;
+
+            size_t bytes() const {
+                size_t res = entities.bytes();
+                for (const auto& image : buckets)
+                    res += image.bytes.size();
+                return res;
+            }
+        };
+
+        // Copies the whole world. Trivially copyable components are copied with one memcpy per bucket, the rest through their
+        // copy constructors. Entities stored in archetypes are not supported, and no on_destroy hook may be running
+        Snapshot snapshot() const {
+            Snapshot res{};
+            std::unique_lock lock{mutex};
+            if (archetype_storage->records.size() != 0)
+                throw std::runtime_error("Snapshots don't cover entities stored in archetypes");
+
+            res.entities = entities;
+            res.tick = tick;
+            for (const auto& [type, bucket] : buckets) {
+                std::unique_lock bucket_lock{bucket->mutex};
+                res.buckets.emplace_back(bucket->save_unlocked());
+            }
+            return res;
+        }
+
+        // Rolls the world back to a snapshot of it (or of another world using the same component types), so every entity
+        // gets back the handle and the components it had. No hooks run: the components are replaced as they are, since
+        // whatever the hooks maintain was captured along with them. Nothing may be iterating the world meanwhile
+        void restore(const Snapshot& snapshot) {
+            Container::check_not_in_parallel_pass();
+            std::unique_lock lock{mutex};
+            if (archetype_storage->records.size() != 0)
+                throw std::runtime_error("Snapshots don't cover entities stored in archetypes");
+
+            std::unordered_map<size_t, const BucketImage*> images{};
+            for (const auto& image : snapshot.buckets)
+                images.emplace(image.type_id, &image);
+
+            entities = snapshot.entities;
+            tick = snapshot.tick;
+            for (const auto& [type, bucket] : buckets) {
+                std::unique_lock bucket_lock{bucket->mutex};
+                const auto it = images.find(type);
+                bucket->load_unlocked(it != images.end() ? it->second : nullptr);
+                bucket->tick.store(tick, std::memory_order_relaxed);
+                if (it != images.end())
+                    images.erase(it);
+            }
+            for (const auto& [type, image] : images) {
+                const auto bucket = image->create();
+                bucket->load_unlocked(image);
+                bucket->tick.store(tick, std::memory_order_relaxed);
+                buckets.add(type, bucket);
+            }
+
+            // The groups lock their buckets, which can't be done while holding the world mutex
+            std::vector<OwningGroupBase*> groups_to_rebuild{};
+            for (const auto& [type, group] : owning_groups)
+                groups_to_rebuild.emplace_back(group.get());
+            lock.unlock();
+            for (const auto group : groups_to_rebuild)
+                group->rebuild();
         }
 
       private:
@@ -1462,16 +3947,317 @@ namespace mgm {
             virtual void ecs_moved(const Ecs* new_loc) = 0;
         };
 
-        std::unordered_set<GroupContainer*> groups{};
+        mutable std::unordered_set<GroupContainer*> groups{};
 
-        template<typename T, typename... Ts>
-        struct _TypeList {
-            using First = T;
+        // Locks a set of buckets for the duration of a bulk iteration pass, always in the same order to avoid deadlocks
+        class BulkPassLock {
+            std::vector<const Container*> locked{};
+
+          public:
+            BulkPassLock(std::vector<const Container*> buckets_to_lock)
+                : locked(std::move(buckets_to_lock)) {
+                std::sort(locked.begin(), locked.end());
+                locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+                for (const auto bucket : locked) {
+                    bucket->mutex.lock();
+                    ++bucket->bulk_passes;
+                }
+            }
+
+            BulkPassLock(const BulkPassLock&) = delete;
+            BulkPassLock(BulkPassLock&&) = delete;
+            BulkPassLock& operator=(const BulkPassLock&) = delete;
+            BulkPassLock& operator=(BulkPassLock&&) = delete;
+
+            ~BulkPassLock() {
+                for (auto it = locked.rbegin(); it != locked.rend(); ++it) {
+                    --(*it)->bulk_passes;
+                    (*it)->mutex.unlock();
+                }
+            }
+        };
+
+        struct TickFilter {
+            size_t type_id = 0;
+            uint64_t since = 0;
+            bool added = false;
         };
+
+      public:
+        // Keeps the entities which have all of Ts packed at the front of every Ts bucket, in the same order, so iterating them
+        // is a linear walk over the dense arrays, without probing any bucket. The order is maintained by the owned buckets
+        // whenever one of their components is created or destroyed, which costs one swap per owned bucket when the entity
+        // enters or leaves the group. A bucket can only be owned by one group, and the group lives as long as the world
+        // Iterators over an owned bucket only account for swap-and-pop moves, so creating or destroying owned components while
+        // one is iterating it throws
         template<typename... Ts>
-        struct TypeList {
-            using First = typename _TypeList<Ts...>::First;
+        class OwningGroup : public OwningGroupBase {
+            friend class MGMecs;
+
+            std::tuple<ComponentBucket<Ts>*...> owned{};
+            // The owned buckets in the order they are locked in, sorted once so the hooks don't allocate
+            std::array<const Container*, sizeof...(Ts)> lock_order{};
+            size_t count = 0;
+
+            struct OwnedLock {
+                const OwningGroup& group;
+
+                explicit OwnedLock(const OwningGroup& owning_group)
+                    : group{owning_group} {
+                    for (const auto bucket : group.lock_order)
+                        bucket->mutex.lock();
+                }
+                OwnedLock(const OwnedLock&) = delete;
+                OwnedLock& operator=(const OwnedLock&) = delete;
+                ~OwnedLock() {
+                    for (auto it = group.lock_order.rbegin(); it != group.lock_order.rend(); ++it)
+                        (*it)->mutex.unlock();
+                }
+            };
+
+            std::vector<const Container*> owned_containers() const { return {lock_order.begin(), lock_order.end()}; }
+
+            // Checked before swapping anything, so no bucket is left swapped while another one refuses to
+            void check_not_iterated() const {
+                if (std::apply([](const auto*... b) { return (... || !b->comp_move_callbacks.empty()); }, owned))
+                    throw std::runtime_error("Can't create or destroy owned components while an iterator is walking one of the owned buckets");
+            }
+
+            void added(const Entity e) override {
+                const OwnedLock lock{*this};
+                const std::array<size_t, sizeof...(Ts)> at = std::apply([e](const auto*... b) { return std::array<size_t, sizeof...(Ts)>{b->dense_index_unlocked(e)...}; }, owned);
+                if (std::find(at.begin(), at.end(), static_cast<size_t>(-1)) != at.end() || at[0] < count)
+                    return;
+                check_not_iterated();
+
+                size_t i = 0;
+                std::apply([&](auto*... b) { (b->swap_slots_unlocked(at[i++], count), ...); }, owned);
+                ++count;
+            }
+
+            void removing(const Entity e) override {
+                const OwnedLock lock{*this};
+                const std::array<size_t, sizeof...(Ts)> at = std::apply([e](const auto*... b) { return std::array<size_t, sizeof...(Ts)>{b->dense_index_unlocked(e)...}; }, owned);
+                if (std::find(at.begin(), at.end(), static_cast<size_t>(-1)) != at.end() || at[0] >= count)
+                    return;
+                check_not_iterated();
+
+                --count;
+                size_t i = 0;
+                std::apply([&](auto*... b) { (b->swap_slots_unlocked(at[i++], count), ...); }, owned);
+            }
+
+            void rebuild() override {
+                std::vector<Entity> existing{};
+                {
+                    const OwnedLock lock{*this};
+                    count = 0;
+                    existing = std::get<0>(owned)->original;
+                }
+                for (const auto e : existing)
+                    added(e);
+            }
+
+          public:
+            explicit OwningGroup(ComponentBucket<Ts>&... buckets)
+                : owned{&buckets...},
+                  lock_order{&buckets...} {
+                std::sort(lock_order.begin(), lock_order.end());
+            }
+
+            OwningGroup(const OwningGroup&) = delete;
+            OwningGroup(OwningGroup&&) = delete;
+            OwningGroup& operator=(const OwningGroup&) = delete;
+            OwningGroup& operator=(OwningGroup&&) = delete;
+
+            size_t size() const {
+                const OwnedLock lock{*this};
+                return count;
+            }
+
+            // Calls fn(entity, Ts&...) for every entity in the group, with the owned buckets locked like in Group::each
+            template<typename Fn>
+            void each(Fn&& fn) {
+                const BulkPassLock lock{owned_containers()};
+                const auto* entities = std::get<0>(owned)->original.data();
+                const auto data = std::apply([](auto*... b) { return std::make_tuple(b->components.data()...); }, owned);
+                for (size_t i = 0; i < count; ++i)
+                    std::apply([&](auto*... c) { fn(entities[i], c[i]...); }, data);
+            }
+        };
+
+        // Creates the owning group for Ts the first time it is called, and returns the same group afterwards
+        template<typename... Ts>
+        OwningGroup<Ts...>& owning_group() {
+            static_assert(sizeof...(Ts) != 0, "An owning group needs at least one component type");
+            static_assert((... && (std::is_move_constructible_v<Ts> && std::is_move_assignable_v<Ts>)), "Owned components must be movable, since the group reorders them");
+            static_assert((... && !ComponentBucket<Ts>::stable_storage), "Components in stable storage can't be owned, since the group reorders them");
+            static_assert((... && !is_tag<Ts>), "Tags have no storage which could be owned");
+
+            std::unique_lock lock{mutex};
+            const auto it = owning_groups.find(TypeID<OwningGroup<Ts...>>{});
+            if (it != owning_groups.end())
+                return *static_cast<OwningGroup<Ts...>*>(it->second.get());
+
+            if ((... || (get_or_create_bucket<Ts>().owner != nullptr)))
+                throw std::runtime_error("A component bucket can only be owned by one group");
+
+            auto group = std::make_unique<OwningGroup<Ts...>>(get_or_create_bucket<Ts>()...);
+            auto& res = *group;
+            owning_groups.emplace(TypeID<OwningGroup<Ts...>>{}, std::move(group));
+
+            // Hook the buckets up first, so entities which get their components meanwhile aren't missed, then pack the ones
+            // which already match (adding an entity twice is a no-op)
+            // Packing locks the buckets, which can't be done while holding the world mutex, since iterators lock them the other way around
+            std::apply([&](auto*... b) { ((b->owner = &res), ...); }, res.owned);
+            lock.unlock();
+
+            std::vector<Entity> existing{};
+            {
+                const auto* first = std::get<0>(res.owned);
+                std::unique_lock first_lock{first->mutex};
+                existing = first->original;
+            }
+            for (const auto e : existing)
+                res.added(e);
+            return res;
+        }
+
+        // Reorders the dense arrays of one bucket a few components at a time, so the work can be spread over several frames
+        // The target order is decided when the pass is created. Entities which lose the component meanwhile are skipped, and
+        // components created meanwhile end up after the sorted ones. Components of entities locked by another thread are never
+        // moved, the step just ends early and the next one picks up from the same entity
+        // Iterators over the bucket only account for swap-and-pop moves, so stepping a pass while one is iterating it throws
+        template<typename T>
+        class SortPass {
+            friend class MGMecs;
+
+            Ecs* ecs = nullptr;
+            ComponentBucket<T>* bucket = nullptr;
+            std::vector<Entity> order{};
+            size_t next = 0;
+            size_t placed = 0;
+
+            SortPass(Ecs& world, ComponentBucket<T>* sorted_bucket, std::vector<Entity> target_order)
+                : ecs(&world),
+                  bucket(sorted_bucket),
+                  order(std::move(target_order)) {}
+
+          public:
+            SortPass() = default;
+
+            bool done() const { return bucket == nullptr || next >= order.size(); }
+
+            // Visits at most budget entities of the target order, and returns true once the whole bucket is in order
+            bool step(size_t budget = static_cast<size_t>(-1)) {
+                if (done())
+                    return true;
+
+                Container::check_not_in_parallel_pass();
+                std::unique_lock lock{bucket->mutex};
+                bucket->check_structural_change_allowed();
+                if (bucket->owner != nullptr)
+                    throw std::runtime_error("A bucket owned by a group can't be sorted, since the group keeps it in its own order");
+                if (!bucket->comp_move_callbacks.empty())
+                    throw std::runtime_error("Can't reorder the components of a bucket while an iterator is walking it");
+
+                for (; budget != 0 && next < order.size(); ++next, --budget) {
+                    const auto e = order[next];
+                    const auto at = bucket->dense_index_unlocked(e);
+                    // Already destroyed, or moved into the sorted part by a swap-and-pop since the pass started
+                    if (at == static_cast<size_t>(-1) || at < placed)
+                        continue;
+
+                    if (at != placed) {
+                        const auto displaced = bucket->original[placed];
+                        if (!ecs->locks.try_lock(e))
+                            break;
+                        if (!ecs->locks.try_lock(displaced)) {
+                            ecs->locks.unlock(e);
+                            break;
+                        }
+                        bucket->swap_slots_unlocked(at, placed);
+                        ecs->locks.unlock(displaced);
+                        ecs->locks.unlock(e);
+                    }
+                    ++placed;
+                }
+                return done();
+            }
+        };
+
+      private:
+        template<typename T>
+        void check_sortable() const {
+            static_assert(!is_tag<T>, "Tags have no storage which could be sorted");
+            static_assert(!ComponentBucket<T>::stable_storage, "Components in stable storage can't be sorted, since they never move");
+            static_assert(std::is_move_constructible_v<T> && std::is_move_assignable_v<T>, "Sorted components must be movable");
+        }
+
+      public:
+        // Whether T's bucket is owned by an owning group, which keeps it in the group's own order, so it can't be sorted
+        template<typename T>
+        bool owned_by_group() const {
+            const auto* bucket = try_get_bucket<T>();
+            if (bucket == nullptr)
+                return false;
+            std::unique_lock lock{bucket->mutex};
+            return bucket->owner != nullptr;
+        }
+
+        // Starts a pass which puts T's components in the order the entities are listed in, the ones missing from the list end up after them
+        template<typename T, typename It>
+        SortPass<T> sort_as(const It& begin, const It& end) {
+            check_sortable<T>();
+            return SortPass<T>{*this, try_get_bucket<T>(), std::vector<Entity>(begin, end)};
+        }
+
+        // Starts a pass which orders T's components by cmp(const T& a, const T& b), like std::stable_sort
+        template<typename T, typename Cmp>
+        SortPass<T> sort(Cmp cmp) {
+            check_sortable<T>();
+            auto* bucket = try_get_bucket<T>();
+            if (bucket == nullptr)
+                return {};
+
+            std::unique_lock lock{bucket->mutex};
+            std::vector<size_t> at(bucket->original.size());
+            for (size_t i = 0; i < at.size(); ++i)
+                at[i] = i;
+            std::stable_sort(at.begin(), at.end(), [&](const size_t a, const size_t b) { return cmp(std::as_const(bucket->components[a]), std::as_const(bucket->components[b])); });
+
+            std::vector<Entity> order(at.size());
+            for (size_t i = 0; i < at.size(); ++i)
+                order[i] = bucket->original[at[i]];
+            return SortPass<T>{*this, bucket, std::move(order)};
+        }
+
+        // Starts a pass which orders T's components by entity index, undoing the shuffling left behind by swap-and-pop
+        template<typename T>
+        SortPass<T> sort_by_entity() {
+            check_sortable<T>();
+            auto* bucket = try_get_bucket<T>();
+            if (bucket == nullptr)
+                return {};
+
+            std::unique_lock lock{bucket->mutex};
+            auto order = bucket->original;
+            lock.unlock();
+            std::sort(order.begin(), order.end(), [](const Entity a, const Entity b) { return a.index() < b.index(); });
+            return SortPass<T>{*this, bucket, std::move(order)};
+        }
+
+      private:
+        std::unordered_map<size_t, std::unique_ptr<OwningGroupBase>> owning_groups{};
+
+        // Which included bucket drove the last bulk pass over each set of included types, and at which tick it was chosen
+        struct DriverChoice {
+            uint64_t tick = 0;
+            size_t index = 0;
         };
+        // Only ever locked last, while the passes already hold their buckets
+        mutable Mutex driver_choices_mutex{};
+        mutable std::unordered_map<size_t, DriverChoice> driver_choices{};
 
       public:
         using GroupCond = std::function<bool(Ecs* ecs, const Entity entity)>;
@@ -1484,12 +4270,16 @@ namespace mgm {
           private:
             using Inc = TypeList<Includes...>;
             using Exc = TypeList<Excludes...>;
-            friend class MGMecs<EntityType>;
+            friend class MGMecs<EntityType, Policy>;
             static constexpr auto const_group = std::is_const<EcsType>{};
             using G = Group<EcsType, TypeList<Includes...>, TypeList<Excludes...>>;
 
+            template<typename, typename, typename>
+            friend struct Group;
+
             EcsType* ecs = nullptr;
             GroupCond cond{};
+            std::vector<TickFilter> tick_filters{};
 
             virtual void ecs_moved(const Ecs* new_loc) override {
                 ecs = const_cast<EcsType*>(new_loc);
@@ -1506,7 +4296,8 @@ namespace mgm {
 
             Group(const Group& g)
                 : ecs(g.ecs),
-                  cond(g.cond) {
+                  cond(g.cond),
+                  tick_filters(g.tick_filters) {
                 if (g.ecs == nullptr)
                     return;
                 std::unique_lock lock{g.ecs->mutex};
@@ -1515,7 +4306,8 @@ namespace mgm {
             }
             Group(Group&& g)
                 : ecs(std::move(g.ecs)),
-                  cond(std::move(g.cond)) {
+                  cond(std::move(g.cond)),
+                  tick_filters(std::move(g.tick_filters)) {
                 if (g.ecs == nullptr)
                     return;
                 std::unique_lock lock{g.ecs->mutex};
@@ -1528,6 +4320,9 @@ namespace mgm {
                 if (this == &g)
                     return *this;
 
+                cond = g.cond;
+                tick_filters = g.tick_filters;
+
                 if (ecs == g.ecs) {
                     if (ecs == nullptr)
                         return *this;
@@ -1546,7 +4341,6 @@ namespace mgm {
                     }
 
                     ecs = g.ecs;
-                    cond = g.cond;
                 }
 
                 return *this;
@@ -1555,6 +4349,9 @@ namespace mgm {
                 if (this == &g)
                     return *this;
 
+                cond = std::move(g.cond);
+                tick_filters = std::move(g.tick_filters);
+
                 if (ecs == g.ecs) {
                     if (ecs == nullptr)
                         return *this;
@@ -1575,7 +4372,6 @@ namespace mgm {
                     }
 
                     ecs = g.ecs;
-                    cond = g.cond;
                 }
 
                 g.ecs = nullptr;
@@ -1588,16 +4384,51 @@ namespace mgm {
                 using Group2 = Group<EcsType, TypeList<Includes..., Ts...>, TypeList<Excludes...>>;
                 if (ecs == nullptr)
                     return Group2{nullptr};
-                return Group2{*ecs, cond};
+                Group2 res{*ecs, cond};
+                res.tick_filters = tick_filters;
+                return res;
             }
             template<typename... Ts>
             auto exclude() {
                 using Group2 = Group<EcsType, TypeList<Includes...>, TypeList<Excludes..., Ts...>>;
                 if (ecs == nullptr)
                     return Group2{nullptr};
-                return Group2{*ecs, cond};
+                Group2 res{*ecs, cond};
+                res.tick_filters = tick_filters;
+                return res;
+            }
+
+            // Only keeps entities whose Ts components were all accessed mutably at or after the given tick (see MGMecs::advance_tick)
+            template<typename... Ts>
+            G changed_since(const uint64_t since) const {
+                G res{*this};
+                (res.tick_filters.emplace_back(TickFilter{TypeID<Ts>{}, since, false}), ...);
+                return res;
+            }
+            // Only keeps entities whose Ts components were all created at or after the given tick
+            template<typename... Ts>
+            G added_since(const uint64_t since) const {
+                G res{*this};
+                (res.tick_filters.emplace_back(TickFilter{TypeID<Ts>{}, since, true}), ...);
+                return res;
+            }
+
+          private:
+            // Locks every filtered bucket on its own, for the iterators
+            bool passes_tick_filters(const Entity e) const {
+                for (const auto& filter : tick_filters) {
+                    const auto* bucket = ecs->try_get_container(filter.type_id);
+                    if (bucket == nullptr)
+                        return false;
+                    std::unique_lock lock{bucket->mutex};
+                    if (bucket->tick_of_unlocked(e, filter.added) < filter.since)
+                        return false;
+                }
+                return true;
             }
 
+          public:
+
             template<bool reverse = false>
             struct Iterator {
                 using iterator_category = std::bidirectional_iterator_tag;
@@ -1653,11 +4484,18 @@ namespace mgm {
 
               private:
                 template<typename T = typename Inc::First>
-                Bucket& get_bucket() const {
+                ComponentBucket<T>& get_bucket() const {
                     return group->ecs->template get_bucket<T>();
                 }
 
                 void setup_callback(Bucket& bucket) {
+                    // Components in stable storage never move, so there is nothing to listen for
+                    if constexpr (Bucket::stable_storage)
+                        return;
+                    else
+                        setup_move_callback(bucket);
+                }
+                void setup_move_callback(Bucket& bucket) {
                     last_move_callback = bucket.comp_move_callbacks.create(bucket.original.back(), [this](Bucket& originating_bucket, size_t from, size_t to) {
                         if (from == p)
                             throw std::runtime_error("INTERNAL ERROR: Iterator callback was not listening to the last component in the bucket");
@@ -1717,9 +4555,9 @@ namespace mgm {
                 template<typename T>
                 bool contains(const Entity e, Bucket& existing_bucket) const {
                     if constexpr (std::is_same_v<ComponentBucket<T>, Bucket>)
-                        return existing_bucket.try_get(e) != nullptr;
+                        return std::as_const(existing_bucket).try_get(e) != nullptr;
                     else
-                        return get_bucket<T>().try_get(e) != nullptr;
+                        return std::as_const(get_bucket<T>()).try_get(e) != nullptr;
                 }
 
                 bool setup_entity_deref(size_t c, Bucket& bucket) {
@@ -1728,41 +4566,31 @@ namespace mgm {
                         return false;
                     }
                     const auto e = bucket.original[c];
-                    const bool success = (setup_single_comp_in_entity_deref<Includes>(e, bucket) || ...) && !(contains<Excludes>(e, bucket) || ...);
-                    if (success)
+                    // Everything is checked without stamping first, so only the components of entities the iterator stops at
+                    // are stamped as changed
+                    const bool success = group->passes_tick_filters(e) && (contains<Includes>(e, bucket) && ...) && !(contains<Excludes>(e, bucket) || ...);
+                    if (success && (setup_single_comp_in_entity_deref<Includes>(e, bucket) && ...))
                         deref_this.e = e;
-                    else
+                    else {
                         deref_this = {};
-                    return success;
+                        return false;
+                    }
+                    return true;
                 }
 
                 // Needed because trying to lock the entity while the bucket lock is still locked can cause a deadlock if another thread is waiting for the bucket before letting go of the entity
                 // But unlocking the bucket might give enough time for the entity to be destroyed or moved before it can be locked
-                void setup_lock(std::unique_lock<std::recursive_mutex>& bucket_lock) {
+                void setup_lock(std::unique_lock<RecursiveMutex>& bucket_lock) {
                     entity_lock.invalidate();
-                    std::unique_lock locks_lock{group->ecs->locks.mutex};
                     bucket_lock.unlock();
 
-                    if (!group->ecs->locks.allow_locking || group->ecs->locks.map.find(deref_this.e) != group->ecs->locks.map.end())
-                        group->ecs->locks.cv.wait(locks_lock, [this] {
-                            if (!group->ecs->locks.allow_locking)
-                                return false;
-
-                            const auto it = group->ecs->locks.map.find(deref_this.e);
-                            if (it == group->ecs->locks.map.end())
-                                return true;
-                            return it->second.thread_id == std::this_thread::get_id();
-                        });
-                    group->ecs->locks._wait_and_lock(deref_this.e);
+                    group->ecs->locks.wait_and_lock(deref_this.e);
 
                     entity_lock.e = deref_this.e;
                     entity_lock.is_locked = true;
                     entity_lock.ecs = group->ecs;
 
                     bucket_lock.lock();
-
-                    locks_lock.unlock();
-                    group->ecs->locks.cv.notify_all();
                 }
 
               public:
@@ -1911,6 +4739,7 @@ namespace mgm {
             };
 
             Iterator<> begin() const {
+                static_assert(!is_tag<std::remove_const_t<typename Inc::First>>, "Iterators walk the first included type, which can't be a tag");
                 if (ecs == nullptr)
                     return Iterator{this, static_cast<size_t>(-1)};
 
@@ -1920,6 +4749,219 @@ namespace mgm {
                 return Iterator{this, static_cast<size_t>(-1)};
             }
 
+          private:
+            template<typename T>
+            using BucketPtr = std::conditional_t<const_group, const ComponentBucket<T>*, ComponentBucket<T>*>;
+
+          public:
+            // Bulk iteration over the per-type buckets, calling fn(entity, Includes&...) for every matching entity
+            // All included and excluded buckets are locked once for the whole pass, instead of locking every entity and registering
+            // move callbacks like the iterators do. Structural changes (emplace, remove, destroy) to any of those buckets throw
+            // until the pass ends, and other threads trying to access them wait for it to finish
+            template<typename Fn>
+            void each(Fn&& fn) const {
+                static_assert(sizeof...(Includes) != 0, "Iterating a group requires at least one included component type");
+                static_assert((... || !is_tag<std::remove_const_t<Includes>>), "Iterating a group requires at least one included component type which isn't a tag");
+                if (ecs == nullptr)
+                    return;
+
+                const std::tuple<BucketPtr<Includes>...> includes{ecs->template try_get_bucket<Includes>()...};
+                const std::tuple<BucketPtr<Excludes>...> excludes{ecs->template try_get_bucket<Excludes>()...};
+                if (std::apply([](const auto*... b) { return (... || (b == nullptr)); }, includes))
+                    return;
+
+                std::vector<std::pair<const Container*, TickFilter>> filters{};
+                if (!resolve_tick_filters(filters))
+                    return;
+
+                const BulkPassLock pass_lock{buckets_to_lock(includes, excludes, filters)};
+                with_driver(includes, [&](const auto* driver_bucket) {
+                    each_in_range(fn, driver_bucket, includes, excludes, filters, 0, driver_bucket->original.size());
+                });
+            }
+
+            // Same as each, but the dense array of the driving bucket is split into ranges which run on a work-stealing pool
+            // (or one after the other on the calling thread, in single threaded worlds)
+            // Every entity is handed to exactly one thread, and the buckets stay locked by the calling thread until all ranges finished,
+            // so no other thread can touch the included components during the pass. fn must only use the references it is given,
+            // other buckets may be read but structural changes throw
+            template<typename Fn>
+            void par_each(Fn&& fn, MGMecsThreadPool& pool = MGMecsThreadPool::shared(), const size_t min_range_size = 1024) const {
+                static_assert(sizeof...(Includes) != 0, "Iterating a group requires at least one included component type");
+                static_assert((... || !is_tag<std::remove_const_t<Includes>>), "Iterating a group requires at least one included component type which isn't a tag");
+                if (ecs == nullptr)
+                    return;
+
+                const std::tuple<BucketPtr<Includes>...> includes{ecs->template try_get_bucket<Includes>()...};
+                const std::tuple<BucketPtr<Excludes>...> excludes{ecs->template try_get_bucket<Excludes>()...};
+                if (std::apply([](const auto*... b) { return (... || (b == nullptr)); }, includes))
+                    return;
+
+                std::vector<std::pair<const Container*, TickFilter>> filters{};
+                if (!resolve_tick_filters(filters))
+                    return;
+
+                const BulkPassLock pass_lock{buckets_to_lock(includes, excludes, filters)};
+
+                with_driver(includes, [&](const auto* driver_bucket) {
+                    const auto count = driver_bucket->original.size();
+                    // A few ranges per thread, so threads which finish early have something left to steal
+                    const auto range_size = std::max(min_range_size, count / (pool.thread_count() * 4) + 1);
+                    const auto ranges = (count + range_size - 1) / range_size;
+
+                    const auto run_range = [&](const size_t r) {
+                        ++Container::parallel_pass_depth;
+                        try {
+                            each_in_range(fn, driver_bucket, includes, excludes, filters, r * range_size, std::min(count, (r + 1) * range_size));
+                        }
+                        catch (...) {
+                            --Container::parallel_pass_depth;
+                            throw;
+                        }
+                        --Container::parallel_pass_depth;
+                    };
+                    // Nothing in a single threaded world may be touched from the pool's threads
+                    if constexpr (!Policy::thread_safe) {
+                        for (size_t r = 0; r < ranges; ++r)
+                            run_range(r);
+                    }
+                    else
+                        pool.parallel_for(ranges, run_range);
+                });
+            }
+
+          private:
+            // False if a filtered type has no bucket, in which case nothing can pass the filters
+            bool resolve_tick_filters(std::vector<std::pair<const Container*, TickFilter>>& res) const {
+                for (const auto& filter : tick_filters) {
+                    const auto* bucket = ecs->try_get_container(filter.type_id);
+                    if (bucket == nullptr)
+                        return false;
+                    res.emplace_back(bucket, filter);
+                }
+                return true;
+            }
+
+            template<typename IncludeBuckets, typename ExcludeBuckets>
+            static std::vector<const Container*> buckets_to_lock(const IncludeBuckets& includes, const ExcludeBuckets& excludes, const std::vector<std::pair<const Container*, TickFilter>>& filters) {
+                std::vector<const Container*> res{};
+                res.reserve(sizeof...(Includes) + sizeof...(Excludes) + filters.size());
+                std::apply([&](const auto*... b) { (res.emplace_back(b), ...); }, includes);
+                std::apply([&](const auto*... b) { ((b != nullptr ? (void)res.emplace_back(b) : (void)0), ...); }, excludes);
+                for (const auto& [bucket, filter] : filters)
+                    res.emplace_back(bucket);
+                return res;
+            }
+
+            // Every other included and excluded bucket is probed once per entity of the driving bucket, so the pass is driven
+            // by the smallest included bucket. The choice is kept until the tick advances, so passes within the same frame
+            // visit the entities in the same order even if the bucket sizes change in between
+            // Expects the buckets to already be locked by a BulkPassLock
+            template<typename IncludeBuckets>
+            size_t driver_index(const IncludeBuckets& includes) const {
+                if constexpr (sizeof...(Includes) == 1)
+                    return 0;
+                else {
+                    // Tag buckets can't list their entities
+                    const auto size_of = [](const auto* b) {
+                        if constexpr (std::remove_pointer_t<decltype(b)>::tag_storage)
+                            return static_cast<size_t>(-1);
+                        else
+                            return b->original.size();
+                    };
+                    const std::array<size_t, sizeof...(Includes)> sizes = std::apply([&](const auto*... b) { return std::array<size_t, sizeof...(Includes)>{size_of(b)...}; }, includes);
+                    const auto now = std::get<0>(includes)->tick.load(std::memory_order_relaxed);
+
+                    std::unique_lock lock{ecs->driver_choices_mutex};
+                    auto& choice = ecs->driver_choices[TypeID<TypeList<std::remove_const_t<Includes>...>>{}];
+                    if (choice.tick != now)
+                        choice = {now, static_cast<size_t>(std::min_element(sizes.begin(), sizes.end()) - sizes.begin())};
+                    return choice.index;
+                }
+            }
+
+            // Calls fn with the driving bucket, as a pointer to its actual type
+            template<size_t I, typename IncludeBuckets, typename Fn>
+            static bool drive_if_chosen(const size_t index, const IncludeBuckets& includes, Fn& fn) {
+                if constexpr (std::remove_pointer_t<std::tuple_element_t<I, IncludeBuckets>>::tag_storage)
+                    return false;
+                else {
+                    if (I != index)
+                        return false;
+                    fn(std::get<I>(includes));
+                    return true;
+                }
+            }
+            template<typename IncludeBuckets, typename Fn, size_t... Is>
+            void with_driver(const IncludeBuckets& includes, Fn&& fn, std::index_sequence<Is...>) const {
+                const auto index = driver_index(includes);
+                (void)(... || drive_if_chosen<Is>(index, includes, fn));
+            }
+            template<typename IncludeBuckets, typename Fn>
+            void with_driver(const IncludeBuckets& includes, Fn&& fn) const {
+                with_driver(includes, std::forward<Fn>(fn), std::index_sequence_for<Includes...>{});
+            }
+
+            // Expects the buckets to already be locked by a BulkPassLock
+            template<typename Fn, typename DriverBucket, typename IncludeBuckets, typename ExcludeBuckets>
+            void each_in_range(Fn& fn, const DriverBucket* driver_bucket, const IncludeBuckets& includes, const ExcludeBuckets& excludes, const std::vector<std::pair<const Container*, TickFilter>>& filters, const size_t begin, const size_t end) const {
+                const auto& driver = driver_bucket->original;
+
+                // Filters on the driving type read its tick arrays directly, instead of looking every entity up
+                uint64_t changed_since = 0;
+                uint64_t added_since = 0;
+                std::vector<std::pair<const Container*, TickFilter>> other_filters{};
+                for (const auto& [bucket, filter] : filters) {
+                    if (bucket != driver_bucket)
+                        other_filters.emplace_back(bucket, filter);
+                    else if (filter.added)
+                        added_since = std::max(added_since, filter.since);
+                    else
+                        changed_since = std::max(changed_since, filter.since);
+                }
+
+                for (size_t i = begin; i < end; ++i) {
+                    if (driver_bucket->changed_ticks[i] < changed_since || driver_bucket->added_ticks[i] < added_since)
+                        continue;
+
+                    const Entity e = driver[i];
+                    if constexpr (DriverBucket::stable_storage)
+                        if (e == null)
+                            continue;
+
+                    const bool excluded = std::apply([e](const auto*... b) { return (... || (b != nullptr && b->try_get_unlocked(e) != nullptr)); }, excludes);
+                    if (excluded)
+                        continue;
+
+                    const bool filtered = std::any_of(other_filters.begin(), other_filters.end(), [e](const auto& f) { return f.first->tick_of_unlocked(e, f.second.added) < f.second.since; });
+                    if (filtered)
+                        continue;
+
+                    // Looked up without stamping first, only the components actually handed to fn are stamped as changed
+                    const bool included = std::apply([e](const auto*... b) { return (... && (b->try_get_unlocked(e) != nullptr)); }, includes);
+                    if (!included)
+                        continue;
+
+                    if (cond && !cond(const_cast<Ecs*>(ecs), e))
+                        continue;
+
+                    std::apply([&](auto*... b) { fn(e, b->get_unlocked(e)...); }, includes);
+                }
+            }
+
+          public:
+
+            // Walk the archetype storage chunk by chunk, calling fn(entity, Includes&...) for every matching entity
+            // Only archetype components are visited, entities stored in component buckets are not part of this walk
+            template<typename Fn>
+            void archetype_each(Fn&& fn) const {
+                if (ecs == nullptr)
+                    return;
+
+                using Cond = std::conditional_t<const_group, TypeList<const Includes...>, TypeList<Includes...>>;
+                ecs->archetype_storage->each(fn, Cond{}, Exc{});
+            }
+
             void invalidate_self() {
                 if (ecs == nullptr)
                     return;
@@ -1960,15 +5002,37 @@ namespace mgm {
             locks.unlock(start, end);
         }
 
+        // Shared locks, for threads which only read the entity's components
+        void wait_and_lock_shared(const Entity e) {
+            locks.wait_and_lock_shared(e);
+        }
+        template<typename It>
+        void wait_and_lock_shared(const It& start, const It& end) {
+            locks.wait_and_lock_shared(start, end);
+        }
+
+        void unlock_shared(const Entity e) {
+            locks.unlock_shared(e);
+        }
+        template<typename It>
+        void unlock_shared(const It& start, const It& end) {
+            locks.unlock_shared(start, end);
+        }
+
         ~MGMecs() {
+            // Tearing the world down in any order is fine, as long as no group tries to keep the buckets sorted meanwhile
+            for (auto& [type, bucket] : buckets)
+                bucket->owner = nullptr;
+
+            if (archetype_storage != nullptr)
+                archetype_storage->destroy_all(this);
+
             while (!buckets.empty()) {
-                const auto it = buckets.begin();
-                const auto bucket = it->second;
+                const auto bucket = buckets.pop();
 
                 while (bucket->count() != 0)
                     bucket->destroy_all(this);
                 delete bucket;
-                buckets.erase(it);
             }
         }
     };
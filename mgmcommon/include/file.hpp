@@ -138,6 +138,61 @@ namespace mgm {
     }
 
 
+    /**
+     * @brief A read-only view of a whole file mapped into memory, unmapped when destroyed
+     */
+    class MappedFile {
+        friend class FileIO;
+
+        const uint8_t* bytes = nullptr;
+        size_t byte_count = 0;
+
+        // Platform specific handle kept alive while the file is mapped (if the platform needs one)
+        void* handle = nullptr;
+
+        void unmap();
+
+      public:
+        MappedFile() = default;
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&& other)
+            : bytes{other.bytes}, byte_count{other.byte_count}, handle{other.handle} {
+            other.bytes = nullptr;
+            other.byte_count = 0;
+            other.handle = nullptr;
+        }
+        MappedFile& operator=(MappedFile&& other) {
+            if (this == &other)
+                return *this;
+            unmap();
+            bytes = other.bytes;
+            byte_count = other.byte_count;
+            handle = other.handle;
+            other.bytes = nullptr;
+            other.byte_count = 0;
+            other.handle = nullptr;
+            return *this;
+        }
+
+        const uint8_t* data() const {
+            return bytes;
+        }
+        size_t size() const {
+            return byte_count;
+        }
+        bool empty() const {
+            return byte_count == 0;
+        }
+
+        ~MappedFile() {
+            unmap();
+        }
+    };
+
+
     class FileIO {
         friend struct Path;
 
@@ -191,6 +246,14 @@ namespace mgm {
          */
         void write_text(const Path& path, const std::string& text);
 
+        /**
+         * @brief Appends text to the end of a file, creating it if it doesn't exist
+         *
+         * @param path The path to the file
+         * @param text The text to append
+         */
+        void append_text(const Path& path, const std::string& text);
+
         /**
          * @brief Reads binary data from a file
          *
@@ -207,6 +270,14 @@ namespace mgm {
          */
         void write_binary(const Path& path, const std::vector<uint8_t>& data);
 
+        /**
+         * @brief Map a whole file into memory for reading, without copying it
+         *
+         * @param path The path to the file
+         * @return MappedFile The mapped contents, empty if the file couldn't be opened or is empty
+         */
+        MappedFile map_file(const Path& path);
+
         /**
          * @brief Checks if a file exists
          *
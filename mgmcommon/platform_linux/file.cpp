@@ -1,5 +1,9 @@
 #include "file.hpp"
+#include "logging.hpp"
+#include <fcntl.h>
 #include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 
@@ -26,4 +30,41 @@ namespace mgm {
         executablePath.pop_back();
         return executablePath;
     }
+
+    MappedFile FileIO::map_file(const Path& path) {
+        CHECK_PATH(path, {});
+
+        const auto path_str = path.platform_path();
+        const int fd = open(path_str.c_str(), O_RDONLY);
+        if (fd < 0) {
+            Logging{"FileIO"}.error("Failed to open file: ", path_str);
+            return {};
+        }
+
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return {};
+        }
+
+        void* const mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping stays valid after the descriptor is closed
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            Logging{"FileIO"}.error("Failed to map file: ", path_str);
+            return {};
+        }
+
+        MappedFile res{};
+        res.bytes = static_cast<const uint8_t*>(mapping);
+        res.byte_count = (size_t)info.st_size;
+        return res;
+    }
+
+    void MappedFile::unmap() {
+        if (bytes != nullptr)
+            munmap(const_cast<uint8_t*>(bytes), byte_count);
+        bytes = nullptr;
+        byte_count = 0;
+    }
 } // namespace mgm
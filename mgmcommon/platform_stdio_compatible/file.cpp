@@ -53,6 +53,19 @@ namespace mgm {
         file << text;
     }
 
+    void FileIO::append_text(const Path& path, const std::string& text) {
+        CHECK_PATH(path, );
+
+        const auto path_str = path.platform_path();
+        auto file = std::ofstream{path_str, std::ios::app};
+        if (!file.is_open()) {
+            Logging{"FileIO"}.error("Failed to open file: ", path_str);
+            return;
+        }
+
+        file << text;
+    }
+
     std::vector<uint8_t> FileIO::read_binary(const Path& path) {
         CHECK_PATH(path, {});
 
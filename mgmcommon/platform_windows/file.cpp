@@ -1,4 +1,5 @@
 #include "file.hpp"
+#include "logging.hpp"
 #include <Windows.h>
 
 namespace mgm {
@@ -50,4 +51,52 @@ namespace mgm {
                 c = '/';
         return str;
     }
+
+    MappedFile FileIO::map_file(const Path& path) {
+        CHECK_PATH(path, {});
+
+        const auto path_str = path.platform_path();
+        const HANDLE file = CreateFileA(path_str.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            Logging{"FileIO"}.error("Failed to open file: ", path_str);
+            return {};
+        }
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return {};
+        }
+
+        // The mapping object keeps the file open, so the file handle itself isn't needed anymore
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            Logging{"FileIO"}.error("Failed to map file: ", path_str);
+            return {};
+        }
+
+        const void* const view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr) {
+            CloseHandle(mapping);
+            Logging{"FileIO"}.error("Failed to map file: ", path_str);
+            return {};
+        }
+
+        MappedFile res{};
+        res.bytes = static_cast<const uint8_t*>(view);
+        res.byte_count = (size_t)size.QuadPart;
+        res.handle = mapping;
+        return res;
+    }
+
+    void MappedFile::unmap() {
+        if (bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (handle != nullptr)
+            CloseHandle(handle);
+        bytes = nullptr;
+        byte_count = 0;
+        handle = nullptr;
+    }
 } // namespace mgm
@@ -18,7 +18,7 @@ namespace mgm {
         rot = static_cast<quatf>(deserialize(SerializedData<vec4f>(json["rotation"])));
     }
 
-    Transform::operator SerializedData<Transform>() {
+    Transform::operator SerializedData<Transform>() const {
         SerializedData<Transform> res{};
         res["position"] = serialize(pos);
         res["scale"] = serialize(scale);
@@ -1,5 +1,6 @@
 #include "ecs.hpp"
 #include "editor_windows/file_browser.hpp"
+#include "editor_windows/scene_journal.hpp"
 #include "editor_windows/scene_view.hpp"
 #include "engine.hpp"
 #include "file.hpp"
@@ -8,9 +9,73 @@
 #include "systems/editor.hpp"
 #include "systems/notifications.hpp"
 #include "tools/mgmecs.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <utility>
 
 
 namespace mgm {
+    namespace {
+        // Write the position of every child in [from, to) back into its node, after an insertion or removal shifted them
+        // The positions belong to the parent's child list, so whoever changes the list only needs to hold the parent, not
+        // every child
+        void renumber_children(mgm::MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& children, const size_t from, size_t to) {
+            to = std::min(to, children.size());
+            for (size_t i = from; i < to; ++i) ecs.get<HierarchyNode>(children[i]).index_in_parent = i;
+        }
+
+        void index_child(HierarchyNode& parent_node, const std::string& name, const MGMecs<>::Entity child) {
+            parent_node.children_by_name.emplace(name, child);
+        }
+
+        void unindex_child(HierarchyNode& parent_node, const std::string& name, const MGMecs<>::Entity child) {
+            auto [it, end] = parent_node.children_by_name.equal_range(name);
+            for (; it != end; ++it) {
+                if (it->second == child) {
+                    parent_node.children_by_name.erase(it);
+                    return;
+                }
+            }
+        }
+
+        // Keeps the parents whose children are changed locked until the end of the scope, the same locks on_construct and
+        // on_destroy take, so nodes created or destroyed under them meanwhile don't race on their children
+        class ParentLocks {
+            MGMecs<>& ecs;
+            std::vector<MGMecs<>::Entity> parents{};
+
+          public:
+            ParentLocks(MGMecs<>& world, const MGMecs<>::Entity first, const MGMecs<>::Entity second = MGMecs<>::null)
+                : ecs{world} {
+                if (first != MGMecs<>::null)
+                    parents.push_back(first);
+                if (second != MGMecs<>::null && second != first)
+                    parents.push_back(second);
+                ecs.wait_and_lock(parents.begin(), parents.end());
+            }
+            ParentLocks(const ParentLocks&) = delete;
+            ParentLocks& operator=(const ParentLocks&) = delete;
+            ~ParentLocks() {
+                ecs.unlock(parents.begin(), parents.end());
+            }
+        };
+
+        // Fewer components than this aren't worth handing to another thread
+        constexpr size_t min_components_per_decode_job = 64;
+
+        // Destroy the nodes create_hierarchy made under the root (their children go along with them), for loads which fail
+        // after the hierarchy was created
+        void destroy_created_hierarchy(MGMecs<>& ecs, const std::vector<MGMecs<>::Entity>& entities, const std::vector<uint32_t>& parents) {
+            std::vector<MGMecs<>::Entity> top_level{};
+            for (size_t i = 1; i < parents.size(); ++i)
+                if (parents[i] == 0)
+                    top_level.emplace_back(entities[i]);
+            ecs.try_destroy(top_level.begin(), top_level.end());
+        }
+    } // namespace
+
     void HierarchyNode::on_construct(mgm::MGMecs<>* ecs, const mgm::MGMecs<>::Entity self) {
         if (ecs == nullptr)
             return;
@@ -20,20 +85,9 @@ namespace mgm {
         ecs->wait_and_lock(parent);
 
         auto& parent_node = ecs->get<HierarchyNode>(parent);
-        if (parent_node.child != mgm::MGMecs<>::null) {
-            ecs->wait_and_lock(parent_node.child);
-
-            auto& child_node = ecs->get<HierarchyNode>(parent_node.child);
-            child_node.prev = self;
-            next = parent_node.child;
-
-            ecs->unlock(parent_node.child);
-            parent_node.child = self;
-        }
-        else
-            parent_node.child = self;
-
-        ++parent_node.num_children;
+        index_in_parent = parent_node.child_entities.size();
+        parent_node.child_entities.push_back(self);
+        index_child(parent_node, name, self);
 
         ecs->unlock(parent);
     }
@@ -46,98 +100,42 @@ namespace mgm {
             ecs->wait_and_lock(parent);
 
             auto& parent_node = ecs->get<HierarchyNode>(parent);
-            if (parent_node.child == self) {
-                parent_node.child = next;
-                if (next != mgm::MGMecs<>::null) {
-                    ecs->wait_and_lock(next);
-                    auto& next_node = ecs->get<HierarchyNode>(next);
-                    next_node.prev = mgm::MGMecs<>::null;
-                    ecs->unlock(next);
-                    next = mgm::MGMecs<>::null;
-                }
-            }
-            else if (prev != mgm::MGMecs<>::null) {
-                ecs->wait_and_lock(prev);
-                auto& prev_node = ecs->get<HierarchyNode>(prev);
-                prev_node.next = next;
-                if (next != mgm::MGMecs<>::null) {
-                    ecs->wait_and_lock(next);
-                    auto& next_node = ecs->get<HierarchyNode>(next);
-                    next_node.prev = prev;
-                    ecs->unlock(next);
-                }
-                ecs->unlock(prev);
+            auto& siblings = parent_node.child_entities;
+            if (index_in_parent < siblings.size() && siblings[index_in_parent] == self) {
+                siblings.erase(siblings.begin() + static_cast<std::ptrdiff_t>(index_in_parent));
+                renumber_children(*ecs, siblings, index_in_parent, siblings.size());
+                unindex_child(parent_node, name, self);
             }
 
-            --parent_node.num_children;
             ecs->unlock(parent);
         }
 
-        const auto children_copy = children();
+        // Detach the children first, so destroying them doesn't erase them one by one from this node
+        const auto children_copy = std::move(child_entities);
+        child_entities.clear();
+        children_by_name.clear();
+        for (const auto c : children_copy) {
+            ecs->wait_and_lock(c);
+            ecs->get<HierarchyNode>(c).parent = mgm::MGMecs<>::null;
+            ecs->unlock(c);
+        }
         ecs->destroy(children_copy.begin(), children_copy.end());
     }
 
-    HierarchyNode::Iterator& HierarchyNode::Iterator::operator++() {
-        if (current == mgm::MGMecs<>::null)
-            return *this;
-
-        current = MagmaEngine{}.ecs().ecs.get<HierarchyNode>(current).next;
+    MGMecs<>::Entity HierarchyNode::next_sibling() const {
+        if (parent == mgm::MGMecs<>::null)
+            return mgm::MGMecs<>::null;
 
-        return *this;
-    }
-    HierarchyNode::Iterator HierarchyNode::Iterator::operator++(int) {
-        auto copy = *this;
-        ++(*this);
-        return copy;
+        const auto& siblings = std::as_const(MagmaEngine{}.ecs().ecs).get<HierarchyNode>(parent).child_entities;
+        return index_in_parent + 1 < siblings.size() ? siblings[index_in_parent + 1] : mgm::MGMecs<>::null;
     }
 
-    HierarchyNode::Iterator& HierarchyNode::Iterator::operator--() {
-        current = MagmaEngine{}.ecs().ecs.get<HierarchyNode>(current).prev;
-
-        return *this;
-    }
-    HierarchyNode::Iterator HierarchyNode::Iterator::operator--(int) {
-        auto copy = *this;
-        --(*this);
-        return copy;
-    }
+    MGMecs<>::Entity HierarchyNode::prev_sibling() const {
+        if (parent == mgm::MGMecs<>::null || index_in_parent == 0)
+            return mgm::MGMecs<>::null;
 
-    HierarchyNode::Iterator HierarchyNode::Iterator::operator+(size_t i) const {
-        if (current == mgm::MGMecs<>::null)
-            return *this;
-
-        auto copy = *this;
-        while (i > 0) {
-            ++copy;
-            --i;
-        }
-        return copy;
-    }
-    HierarchyNode::Iterator& HierarchyNode::Iterator::operator+=(size_t i) {
-        if (current == mgm::MGMecs<>::null)
-            return *this;
-
-        while (i > 0) {
-            ++(*this);
-            --i;
-        }
-        return *this;
-    }
-
-    HierarchyNode::Iterator HierarchyNode::Iterator::operator-(size_t i) const {
-        auto copy = *this;
-        while (i > 0) {
-            --copy;
-            --i;
-        }
-        return copy;
-    }
-    HierarchyNode::Iterator& HierarchyNode::Iterator::operator-=(size_t i) {
-        while (i > 0) {
-            --(*this);
-            --i;
-        }
-        return *this;
+        const auto& siblings = std::as_const(MagmaEngine{}.ecs().ecs).get<HierarchyNode>(parent).child_entities;
+        return index_in_parent - 1 < siblings.size() ? siblings[index_in_parent - 1] : mgm::MGMecs<>::null;
     }
 
     void HierarchyNode::reparent(MGMecs<>::Entity new_parent, size_t index) {
@@ -147,138 +145,136 @@ namespace mgm {
         auto& ecs = MagmaEngine{}.ecs().ecs;
 
         const auto self = ecs.as_entity(*this);
+        const ParentLocks locks{ecs, parent, new_parent};
 
         if (parent == new_parent) {
-            auto& parent_node = ecs.get<HierarchyNode>(parent);
-
-            const auto old_index = parent_node.find_child_index(self);
-            if (old_index == index)
+            if (parent == mgm::MGMecs<>::null)
                 return;
 
-            if (index > old_index)
-                --index;
-
-            if (parent_node.child == self)
-                parent_node.child = next;
-
-            if (next != MGMecs<>::null)
-                ecs.get<HierarchyNode>(next).prev = prev;
-            if (prev != MGMecs<>::null)
-                ecs.get<HierarchyNode>(prev).next = next;
-
-            next = MGMecs<>::null;
-            prev = MGMecs<>::null;
+            auto& siblings = ecs.get<HierarchyNode>(parent).child_entities;
 
-            if (index == 0) {
-                next = parent_node.child;
-                parent_node.child = self;
-                ecs.get<HierarchyNode>(next).prev = self;
+            const auto old_index = index_in_parent;
+            if (old_index == index)
                 return;
-            }
 
-            auto it = parent_node.begin();
-            Iterator prev_it{MGMecs<>::null};
-            while (index > 0 && it != parent_node.end()) {
-                prev_it = it++;
+            if (index > old_index)
                 --index;
-            }
+            index = std::min(index, siblings.size() - 1);
 
-            if (it == parent_node.end()) {
-                ecs.get<HierarchyNode>(*prev_it).next = self;
-                prev = *prev_it;
-                return;
-            }
-
-            ecs.get<HierarchyNode>(*it).prev = self;
-            ecs.get<HierarchyNode>(*prev_it).next = self;
-            next = *it;
-            prev = *prev_it;
+            siblings.erase(siblings.begin() + static_cast<std::ptrdiff_t>(old_index));
+            siblings.insert(siblings.begin() + static_cast<std::ptrdiff_t>(index), self);
+            renumber_children(ecs, siblings, std::min(old_index, index), std::max(old_index, index) + 1);
 
             return;
         }
 
         if (parent != mgm::MGMecs<>::null) {
             auto& parent_node = ecs.get<HierarchyNode>(parent);
-            if (parent_node.child == self) {
-                parent_node.child = next;
-            }
-            if (prev != mgm::MGMecs<>::null) {
-                auto& prev_node = ecs.get<HierarchyNode>(prev);
-                prev_node.next = next;
-            }
-            if (next != mgm::MGMecs<>::null) {
-                auto& next_node = ecs.get<HierarchyNode>(next);
-                next_node.prev = prev;
-            }
-            prev = mgm::MGMecs<>::null;
-            next = mgm::MGMecs<>::null;
+            auto& siblings = parent_node.child_entities;
+            siblings.erase(siblings.begin() + static_cast<std::ptrdiff_t>(index_in_parent));
+            renumber_children(ecs, siblings, index_in_parent, siblings.size());
+            unindex_child(parent_node, name, self);
 
-            --parent_node.num_children;
             parent = mgm::MGMecs<>::null;
+            index_in_parent = 0;
         }
 
         if (new_parent != mgm::MGMecs<>::null) {
-            auto& new_parent_node = ecs.get<HierarchyNode>(new_parent);
-            if (index == 0) {
-                if (new_parent_node.child != mgm::MGMecs<>::null) {
-                    auto& child_node = ecs.get<HierarchyNode>(new_parent_node.child);
-                    child_node.prev = self;
-                }
-                next = new_parent_node.child;
-                new_parent_node.child = self;
-            }
-            else {
-                Iterator prev_it{};
-                auto it = new_parent_node.begin();
-                while (index > 0 && it != new_parent_node.end()) {
-                    prev_it = it;
-                    ++it;
-                    --index;
-                }
+            auto& parent_node = ecs.get<HierarchyNode>(new_parent);
+            auto& siblings = parent_node.child_entities;
+            index = std::min(index, siblings.size());
+            siblings.insert(siblings.begin() + static_cast<std::ptrdiff_t>(index), self);
+            renumber_children(ecs, siblings, index, siblings.size());
+            index_child(parent_node, name, self);
 
-                if (it != new_parent_node.end()) {
-                    auto& next_node = ecs.get<HierarchyNode>(*it);
-                    next = *it;
-                    next_node.prev = self;
-                }
-                auto& prev_node = ecs.get<HierarchyNode>(*prev_it);
-                prev = *prev_it;
-                prev_node.next = self;
-            }
-            ++new_parent_node.num_children;
             parent = new_parent;
         }
     }
 
-    size_t HierarchyNode::find_child_index(MGMecs<>::Entity entity) const {
-        size_t i = 0;
-        for (const auto c : *this) {
-            if (c == entity)
-                return i;
-            ++i;
+    void HierarchyNode::rename(const std::string& new_name) {
+        if (new_name == name)
+            return;
+
+        if (parent == mgm::MGMecs<>::null) {
+            name = new_name;
+            return;
         }
 
+        auto& ecs = MagmaEngine{}.ecs().ecs;
+        const auto self = ecs.as_entity(*this);
+        const ParentLocks locks{ecs, parent};
+        auto& parent_node = ecs.get<HierarchyNode>(parent);
+
+        unindex_child(parent_node, name, self);
+        name = new_name;
+        index_child(parent_node, name, self);
+    }
+
+    size_t HierarchyNode::find_child_index(MGMecs<>::Entity entity) const {
+        const auto& ecs = std::as_const(MagmaEngine{}.ecs().ecs);
+        const auto* node = ecs.try_get<HierarchyNode>(entity);
+        if (node == nullptr)
+            return static_cast<size_t>(-1);
+
+        const auto i = node->index_in_parent;
+        if (i < child_entities.size() && child_entities[i] == entity)
+            return i;
+
         return static_cast<size_t>(-1);
     }
 
     MGMecs<>::Entity HierarchyNode::get_child_at(size_t i) const {
-        auto it = begin();
-        while (i > 0 && it != end()) {
-            ++it;
-            --i;
-        }
+        if (i >= child_entities.size())
+            return mgm::MGMecs<>::null;
 
-        return *it;
+        return child_entities[i];
     }
 
     MGMecs<>::Entity HierarchyNode::get_child_by_name(const std::string& child_name) const {
-        for (const auto entity : *this) {
-            const auto& node = MagmaEngine{}.ecs().ecs.get<HierarchyNode>(entity);
-            if (node.name == child_name)
-                return entity;
+        const auto [begin, end] = children_by_name.equal_range(child_name);
+        if (begin == end)
+            return mgm::MGMecs<>::null;
+        if (std::next(begin) == end)
+            return begin->second;
+
+        // Of several children with the name, the first one in order is the one it refers to
+        const auto& ecs = std::as_const(MagmaEngine{}.ecs().ecs);
+        auto res = begin->second;
+        auto res_index = ecs.get<HierarchyNode>(res).index_in_parent;
+        for (auto it = std::next(begin); it != end; ++it) {
+            const auto index = ecs.get<HierarchyNode>(it->second).index_in_parent;
+            if (index < res_index) {
+                res = it->second;
+                res_index = index;
+            }
         }
+        return res;
+    }
 
-        return mgm::MGMecs<>::null;
+    MGMecs<>::Entity HierarchyNode::find_by_path(const std::string& path) const {
+        const auto& ecs = std::as_const(MagmaEngine{}.ecs().ecs);
+        if (path.empty())
+            return ecs.as_entity(*this);
+
+        const HierarchyNode* node = this;
+        auto res = mgm::MGMecs<>::null;
+        size_t pos = 0;
+        while (pos <= path.size()) {
+            auto end = path.find('/', pos);
+            if (end == std::string::npos)
+                end = path.size();
+            // Leading, trailing or doubled slashes don't name a node
+            if (end == pos)
+                return mgm::MGMecs<>::null;
+
+            res = node->get_child_by_name(path.substr(pos, end - pos));
+            if (res == mgm::MGMecs<>::null)
+                return mgm::MGMecs<>::null;
+
+            node = &ecs.get<HierarchyNode>(res);
+            pos = end + 1;
+        }
+        return res;
     }
 
 
@@ -292,26 +288,38 @@ namespace mgm {
         }
 
         const auto new_scene_root = ecs.create();
-        const JObject scene_data = engine.file_io().read_text(path);
-        deserialize_node(new_scene_root, scene_data);
+        load_scene(new_scene_root, path);
 
         editable_scenes[path] = new_scene_root;
+        sort_by_hierarchy();
         return new_scene_root;
     }
 
     JObject EntityComponentSystem::serialize_entity_components(const MGMecs<>::Entity entity) {
+        // Only the types the entity actually has are visited, instead of asking every serialized type for a component
         JObject res{};
-        for (const auto& [type, serializer] : serialized_types) {
-            if (!serializer.serialize)
+        for (const auto type_id : ecs.component_types(entity)) {
+            if (type_id >= serialized_types_by_ecs_id.size())
+                continue;
+            const auto& [id, serializer] = serialized_types_by_ecs_id[type_id];
+            if (serializer == nullptr || !serializer->serialize)
                 continue;
 
-            const auto json = serializer.serialize(entity);
+            const auto json = serializer->serialize(entity);
             if (!json.empty())
-                res[type] = json;
+                res[*id] = json;
         }
         return res;
     }
 
+    std::vector<JObject> EntityComponentSystem::serialize_components(const EntityIndex& index) {
+        std::vector<JObject> res(index.size());
+        for (const auto& [type, serializer] : serialized_types)
+            if (serializer.serialize_many)
+                serializer.serialize_many(index, res);
+        return res;
+    }
+
     void EntityComponentSystem::deserialize_entity_components(const MGMecs<>::Entity entity, const JObject& json) {
         for (const auto& [key, value] : json) {
             const auto it = serialized_types.find(key);
@@ -323,6 +331,12 @@ namespace mgm {
     }
 
     JObject EntityComponentSystem::serialize_node(const MGMecs<>::Entity entity) {
+        const EntityIndex index{hierarchy_order(entity)};
+        auto components = serialize_components(index);
+        return serialize_node(entity, index, components);
+    }
+
+    JObject EntityComponentSystem::serialize_node(const MGMecs<>::Entity entity, const EntityIndex& index, std::vector<JObject>& components) {
         JObject res{};
         res.array();
 
@@ -331,8 +345,8 @@ namespace mgm {
 
             const auto& node = ecs.get<HierarchyNode>(e);
             entry["name"] = node.name;
-            entry["components"] = serialize_entity_components(e);
-            entry["children"] = serialize_node(e);
+            entry["components"] = std::move(components[index.find(e)]);
+            entry["children"] = serialize_node(e, index, components);
 
             res.emplace_back(entry);
         }
@@ -346,25 +360,300 @@ namespace mgm {
             return;
         }
 
-        ecs.get_or_emplace<HierarchyNode>(entity, MGMecs<>::null).name = json["name"];
+        // Flatten the tree into depth-first order and stage every component with its type. This is the only part which walks
+        // the tree itself, so the workers below each only parse the Json of their own components
+        std::vector<uint32_t> parents{};
+        std::vector<std::string> names{};
+        std::unordered_map<std::string, std::unique_ptr<StagedComponents>> staged{};
+
+        std::vector<std::pair<const JObject*, uint32_t>> to_visit{
+            {&json, binary_scene::no_parent}
+        };
+        while (!to_visit.empty()) {
+            const auto [node, parent] = to_visit.back();
+            to_visit.pop_back();
+
+            const auto position = static_cast<uint32_t>(parents.size());
+            parents.emplace_back(parent);
+            names.emplace_back((*node)["name"]);
+
+            for (const auto& [key, value] : (*node)["components"]) {
+                const std::string type_id = key;
+                auto it = staged.find(type_id);
+                if (it == staged.end()) {
+                    const auto type = serialized_types.find(type_id);
+                    it = staged.emplace(type_id, type != serialized_types.end() && type->second.stage ? type->second.stage() : nullptr).first;
+                }
+                if (it->second == nullptr)
+                    continue;
+
+                it->second->positions.emplace_back(position);
+                it->second->jsons.emplace_back(&value);
+            }
+
+            if (!node->has("children"))
+                continue;
+
+            // Pushed in reverse, so the first child is visited first
+            const auto& children = (*node)["children"].array();
+            for (auto it = children.rbegin(); it != children.rend(); ++it)
+                if (it->type() == JObject::Type::OBJECT && it->has("components") && it->has("name"))
+                    to_visit.emplace_back(&*it, position);
+        }
+
+        // Decode in contiguous ranges of the depth-first order (so each job decodes the components of a few subtrees), a few
+        // ranges per thread so threads which finish early can steal the rest
+        auto& pool = MGMecsThreadPool::shared();
+        std::vector<std::tuple<StagedComponents*, size_t, size_t>> ranges{};
+        for (const auto& [id, components] : staged) {
+            if (components == nullptr)
+                continue;
+            components->prepare();
+
+            const auto count = components->jsons.size();
+            const auto range_size = std::max(min_components_per_decode_job, count / (pool.thread_count() * 4) + 1);
+            for (size_t begin = 0; begin < count; begin += range_size)
+                ranges.emplace_back(components.get(), begin, std::min(count, begin + range_size));
+        }
+        pool.parallel_for(ranges.size(), [&ranges](const size_t r) {
+            const auto& [components, begin, end] = ranges[r];
+            components->decode(begin, end);
+        });
+
+        const auto entities = create_hierarchy(entity, parents, names);
+        try {
+            for (const auto& [id, components] : staged)
+                if (components != nullptr)
+                    components->commit(ecs, entities);
+        }
+        catch (...) {
+            destroy_created_hierarchy(ecs, entities, parents);
+            throw;
+        }
+    }
+
+    JObject EntityComponentSystem::serialize_scene(const MGMecs<>::Entity entity) {
+        const EntityIndex index{hierarchy_order(entity)};
+        auto components = serialize_components(index);
+
+        JObject res{};
+        res["name"] = ecs.get<HierarchyNode>(entity).name;
+        res["components"] = std::move(components[0]);
+        res["children"] = serialize_node(entity, index, components);
+        return res;
+    }
+
+    std::vector<uint8_t> EntityComponentSystem::serialize_scene_binary(const MGMecs<>::Entity entity) {
+        const EntityIndex index{hierarchy_order(entity)};
+
+        std::vector<uint8_t> res{};
+        binary_scene::write(res, binary_scene::magic, sizeof(binary_scene::magic));
+        binary_scene::write_value(res, binary_scene::version);
+
+        // Parents come before their children in depth-first order, so every parent is already in the index
+        binary_scene::write_value(res, static_cast<uint32_t>(index.size()));
+        for (uint32_t i = 0; i < index.size(); ++i) {
+            const auto& node = std::as_const(ecs).get<HierarchyNode>(index.entities[i]);
+            binary_scene::write_value(res, i == 0 ? binary_scene::no_parent : index.find(node.parent));
+            binary_scene::write_value(res, static_cast<uint32_t>(node.name.size()));
+            binary_scene::write(res, node.name.data(), node.name.size());
+        }
+
+        // Written in order of their identifiers, so saving the same scene twice gives the same file
+        std::vector<std::pair<const std::string*, const SerializedType*>> types{};
+        for (const auto& [id, type] : serialized_types)
+            if (type.serialize_binary)
+                types.emplace_back(&id, &type);
+        std::sort(types.begin(), types.end(), [](const auto& a, const auto& b) { return *a.first < *b.first; });
+
+        const auto block_count_at = res.size();
+        binary_scene::write_value(res, uint32_t{0});
+
+        uint32_t block_count = 0;
+        std::vector<uint8_t> block{};
+        for (const auto& [id, type] : types) {
+            block.clear();
+            if (!type->serialize_binary(index, block))
+                continue;
+
+            binary_scene::write_value(res, static_cast<uint32_t>(id->size()));
+            binary_scene::write(res, id->data(), id->size());
+            binary_scene::write_value(res, static_cast<uint64_t>(block.size()));
+            binary_scene::write(res, block.data(), block.size());
+            ++block_count;
+        }
+        std::memcpy(res.data() + block_count_at, &block_count, sizeof(block_count));
+
+        return res;
+    }
+
+    std::vector<MGMecs<>::Entity> EntityComponentSystem::create_hierarchy(const MGMecs<>::Entity entity, const std::vector<uint32_t>& parents, std::vector<std::string>& names) {
+        std::vector<MGMecs<>::Entity> entities{entity};
+        const auto created = ecs.create_many(parents.size() - 1);
+        entities.insert(entities.end(), created.begin(), created.end());
 
-        deserialize_entity_components(entity, json["components"]);
+        ecs.get_or_emplace<HierarchyNode>(entity, MGMecs<>::null).rename(names[0]);
+
+        // Parents come before their children, so appending each node to its parent in this order keeps the children in order
+        std::vector<HierarchyNode> nodes{};
+        nodes.reserve(parents.size() - 1);
+        for (size_t i = 1; i < parents.size(); ++i) nodes.emplace_back(entities[parents[i]]).name = std::move(names[i]);
+        ecs.emplace_each<HierarchyNode>(entities.begin() + 1, entities.end(), nodes.begin());
+
+        return entities;
+    }
+
+    void EntityComponentSystem::deserialize_scene_binary(const MGMecs<>::Entity entity, const uint8_t* data, const size_t size) {
+        binary_scene::Reader reader{data, data + size};
+
+        if (std::memcmp(reader.take(sizeof(binary_scene::magic)), binary_scene::magic, sizeof(binary_scene::magic)) != 0)
+            throw std::runtime_error("Data is not a binary scene");
+        if (reader.read_value<uint32_t>() > binary_scene::version)
+            throw std::runtime_error("Binary scene was saved by a newer version of the engine");
+
+        // The whole hierarchy is read before anything is created, so a truncated file doesn't leave half a tree behind
+        const auto count = reader.read_value<uint32_t>();
+        if (count == 0)
+            throw std::runtime_error("Binary scene has no root");
+
+        std::vector<uint32_t> parents(count);
+        std::vector<std::string> names(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            parents[i] = reader.read_value<uint32_t>();
+            if (i == 0 ? parents[i] != binary_scene::no_parent : parents[i] >= i)
+                throw std::runtime_error("Binary scene hierarchy is not in depth-first order");
+
+            const auto name_size = reader.read_value<uint32_t>();
+            const auto name = reinterpret_cast<const char*>(reader.take(name_size));
+            names[i].assign(name, name_size);
+        }
+
+        // Components are read straight into the entities, so a block which turns out to be broken takes the created nodes
+        // down with it
+        const auto entities = create_hierarchy(entity, parents, names);
+        try {
+            const auto block_count = reader.read_value<uint32_t>();
+            for (uint32_t i = 0; i < block_count; ++i) {
+                const auto id_size = reader.read_value<uint32_t>();
+                const auto id = reinterpret_cast<const char*>(reader.take(id_size));
+                const auto block_size = static_cast<size_t>(reader.read_value<uint64_t>());
+                const auto block_data = reader.take(block_size);
+
+                // Blocks of types which aren't registered anymore are skipped, the same way unknown keys are in Json scenes
+                const auto it = serialized_types.find(std::string{id, id_size});
+                if (it == serialized_types.end() || !it->second.deserialize_binary)
+                    continue;
+
+                binary_scene::Reader block{block_data, block_data + block_size};
+                it->second.deserialize_binary(entities, block);
+            }
+        }
+        catch (...) {
+            destroy_created_hierarchy(ecs, entities, parents);
+            throw;
+        }
+    }
 
-        if (!json.has("children"))
+    EntityComponentSystem::SceneFormat EntityComponentSystem::scene_format(const Path& path) {
+        auto& file_io = MagmaEngine{}.file_io();
+        if (!file_io.exists(path))
+            return SceneFormat::JSON;
+
+        const auto file = file_io.map_file(path);
+        if (file.size() >= sizeof(binary_scene::magic) && std::memcmp(file.data(), binary_scene::magic, sizeof(binary_scene::magic)) == 0)
+            return SceneFormat::BINARY;
+        return SceneFormat::JSON;
+    }
+
+    void EntityComponentSystem::load_scene(const MGMecs<>::Entity entity, const Path& path) {
+        auto& file_io = MagmaEngine{}.file_io();
+
+        if (scene_format(path) == SceneFormat::BINARY) {
+            const auto file = file_io.map_file(path);
+            deserialize_scene_binary(entity, file.data(), file.size());
             return;
+        }
 
-        const auto& children = json["children"].array();
+        const JObject scene_data = file_io.exists(path) ? JObject{file_io.read_text(path)} : JObject{};
+        deserialize_node(entity, scene_data);
+    }
 
-        for (auto it = children.rbegin(); it != children.rend(); ++it) {
-            const auto& child_json = *it;
-            if (child_json.type() != JObject::Type::OBJECT)
+    void EntityComponentSystem::save_scene(const MGMecs<>::Entity entity, const Path& path, const SceneFormat format) {
+        auto& file_io = MagmaEngine{}.file_io();
+        if (format == SceneFormat::BINARY)
+            file_io.write_binary(path, serialize_scene_binary(entity));
+        else
+            file_io.write_text(path, serialize_scene(entity));
+    }
+
+    void EntityComponentSystem::convert_scene(const Path& path, const SceneFormat format) {
+#if defined(ENABLE_EDITOR)
+        const auto it = editable_scenes.find(path);
+        if (it != editable_scenes.end()) {
+            // Converted through the scene's journal, whose next compaction would otherwise write the old format back
+            if (auto* const journal = SceneJournal::of(path))
+                journal->convert(format);
+            else
+                save_scene(it->second, path, format);
+            return;
+        }
+#endif
+
+        const auto scene_root = ecs.create();
+        load_scene(scene_root, path);
+        save_scene(scene_root, path, format);
+        ecs.destroy(scene_root);
+    }
+
+    std::vector<MGMecs<>::Entity> EntityComponentSystem::hierarchy_order(const MGMecs<>::Entity entity) const {
+        std::vector<MGMecs<>::Entity> res{};
+        std::vector<MGMecs<>::Entity> to_visit{entity};
+
+        while (!to_visit.empty()) {
+            const auto e = to_visit.back();
+            to_visit.pop_back();
+            res.emplace_back(e);
+
+            // Pushed in reverse, so the first child is visited first
+            const auto& children = ecs.get<HierarchyNode>(e).child_entities;
+            to_visit.insert(to_visit.end(), children.rbegin(), children.rend());
+        }
+
+        return res;
+    }
+
+    void EntityComponentSystem::sort_by_hierarchy() {
+        auto order = hierarchy_order(root);
+#if defined(ENABLE_EDITOR)
+        for (const auto& [scene_path, scene_root] : editable_scenes) {
+            const auto scene_order = hierarchy_order(scene_root);
+            order.insert(order.end(), scene_order.begin(), scene_order.end());
+        }
+#endif
+
+        // Buckets owned by a group are kept in the group's order instead, so they get no pass
+        hierarchy_sort_steps.clear();
+        if (!ecs.owned_by_group<HierarchyNode>()) {
+            hierarchy_sort_steps.emplace_back([pass = ecs.sort_as<HierarchyNode>(order.begin(), order.end())](const size_t budget) mutable {
+                return pass.step(budget);
+            });
+        }
+        for (const auto& [type, serializer] : serialized_types) {
+            if (!serializer.sort_as)
                 continue;
-            const auto c = ecs.create();
-            ecs.emplace<HierarchyNode>(c, entity).name = child_json["name"];
-            deserialize_node(c, child_json);
+            if (auto step = serializer.sort_as(order))
+                hierarchy_sort_steps.emplace_back(std::move(step));
         }
     }
 
+    bool EntityComponentSystem::step_hierarchy_sort(const size_t budget) {
+        hierarchy_sort_steps.erase(
+            std::remove_if(hierarchy_sort_steps.begin(), hierarchy_sort_steps.end(), [budget](auto& step) { return step(budget); }),
+            hierarchy_sort_steps.end()
+        );
+        return hierarchy_sort_steps.empty();
+    }
+
 #if defined(ENABLE_EDITOR)
     bool EntityComponentSystem::draw_palette_options() {
         auto& editor = MagmaEngine{}.editor();
@@ -404,6 +693,23 @@ namespace mgm {
                 );
             }
 
+            const auto convert_button = [&](const char* label, const SceneFormat format, const std::string& format_name) {
+                if (!ImGui::SmallButton(label))
+                    return;
+                editor.add_window<FileBrowser>(
+                    true,
+                    FileBrowser::Args{
+                        .mode = FileBrowser::Mode::READ, .type = FileBrowser::Type::FILE, .callback = [format, format_name](const Path& path) {
+                    MagmaEngine engine{};
+                    engine.ecs().convert_scene(path, format);
+                    engine.notifications().push("Converted scene to " + format_name + ": " + path.platform_path());
+                }, .allow_paths_outside_project = false
+                    }
+                );
+            };
+            convert_button("Convert Scene To Binary", SceneFormat::BINARY, "binary");
+            convert_button("Convert Scene To Json", SceneFormat::JSON, "Json");
+
             editor.end_window_here();
         }
 
@@ -0,0 +1,130 @@
+#include "editor_windows/ecs_stats.hpp"
+#include "ecs.hpp"
+#include "engine.hpp"
+#include "imgui.h"
+#include <cfloat>
+#include <cstdio>
+#include <iterator>
+#include <string>
+
+
+namespace mgm {
+    static std::string format_bytes(const size_t bytes) {
+        constexpr const char* units[] = {"B", "KiB", "MiB", "GiB"};
+        auto value = static_cast<double>(bytes);
+        size_t unit = 0;
+        while (value >= 1024.0 && unit < std::size(units) - 1) {
+            value /= 1024.0;
+            ++unit;
+        }
+        char buf[32]{};
+        std::snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+        return buf;
+    }
+
+    static void plot(const char* label, const std::vector<float>& values, const size_t offset, const std::string& overlay, const float height) {
+        ImGui::PlotLines(label, values.data(), static_cast<int>(values.size()), static_cast<int>(offset), overlay.c_str(), 0.0f, FLT_MAX, {0.0f, height});
+    }
+
+    void EcsStatsWindow::History::push(const float value) {
+        values[next] = value;
+        next = (next + 1) % values.size();
+    }
+
+    void EcsStatsWindow::sample() {
+        MagmaEngine engine{};
+        last = engine.ecs().ecs.stats();
+
+        last_latent_destruction = 0;
+        for (const auto& bucket : last.buckets) {
+            last_latent_destruction += bucket.latent_destruction;
+            bucket_bytes[bucket.type_id].push(static_cast<float>(bucket.total_bytes()));
+        }
+
+        total_bytes.push(static_cast<float>(last.total_bytes()));
+        entities.push(static_cast<float>(last.entities));
+        latent_destruction.push(static_cast<float>(last_latent_destruction));
+        entity_locks.push(static_cast<float>(last.entity_locks_held));
+    }
+
+    void EcsStatsWindow::draw_contents() {
+        MagmaEngine engine{};
+
+        time_since_last_sample += engine.delta_time();
+        if (time_since_last_sample >= sample_interval) {
+            time_since_last_sample = 0.0f;
+            sample();
+        }
+
+        const auto width = ImGui::GetContentRegionAvail().x;
+        ImGui::PushItemWidth(width * 0.5f);
+        plot("Memory", total_bytes.values, total_bytes.next, format_bytes(last.total_bytes()), 60.0f);
+        ImGui::SameLine();
+        plot("Entities", entities.values, entities.next, std::to_string(last.entities) + " / " + std::to_string(last.entity_indices) + " indices", 60.0f);
+        plot("Latent destruction", latent_destruction.values, latent_destruction.next, std::to_string(last_latent_destruction) + " components", 60.0f);
+        ImGui::SameLine();
+        plot("Entity locks", entity_locks.values, entity_locks.next, std::to_string(last.entity_locks_held) + " held, " + std::to_string(last.entity_lock_slots) + " lock words", 60.0f);
+        ImGui::PopItemWidth();
+
+        ImGui::Text("Entity slots: %s, archetypes: %zu (%zu entities, %s)", format_bytes(last.entity_bytes).c_str(), last.archetypes, last.archetype_entities, format_bytes(last.archetype_bytes).c_str());
+
+        constexpr auto table_flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_Resizable | ImGuiTableFlags_ScrollY;
+        if (!ImGui::BeginTable("Buckets", 10, table_flags))
+            return;
+
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Component");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableSetupColumn("Capacity");
+        ImGui::TableSetupColumn("Dense");
+        ImGui::TableSetupColumn("Sparse");
+        ImGui::TableSetupColumn("Maps");
+        ImGui::TableSetupColumn("Latent");
+        ImGui::TableSetupColumn("Load factor");
+        ImGui::TableSetupColumn("Callbacks");
+        ImGui::TableSetupColumn("Memory over time");
+        ImGui::TableHeadersRow();
+
+        for (const auto& bucket : last.buckets) {
+            ImGui::TableNextRow();
+            ImGui::PushID(static_cast<int>(bucket.type_id));
+
+            // Types registered for serialization are shown by their identifier, the rest by their (implementation defined) type name
+            auto name = engine.ecs().type_unique_identifier(bucket.type_hash);
+            if (name.empty())
+                name = bucket.type_name;
+            if (bucket.tag)
+                name += " (tag)";
+            else if (bucket.stable)
+                name += " (stable)";
+
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", bucket.count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", bucket.capacity);
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(format_bytes(bucket.dense_bytes).c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(format_bytes(bucket.sparse_bytes).c_str());
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(format_bytes(bucket.map_bytes).c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", bucket.latent_destruction);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", static_cast<double>(bucket.latent_load_factor));
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", bucket.callbacks);
+            ImGui::TableNextColumn();
+            ImGui::PushItemWidth(-FLT_MIN);
+            const auto& history = bucket_bytes[bucket.type_id];
+            plot("##memory", history.values, history.next, "", ImGui::GetTextLineHeight());
+            ImGui::PopItemWidth();
+
+            ImGui::PopID();
+        }
+
+        ImGui::EndTable();
+    }
+} // namespace mgm
@@ -1,3 +1,4 @@
+#include "editor_windows/ecs_stats.hpp"
 #include "editor_windows/file_browser.hpp"
 #include "editor_windows/settings.hpp"
 #include "engine.hpp"
@@ -86,6 +87,11 @@ namespace mgm {
                 something_selected = true;
             }
 
+            if (ImGui::SmallButton("ECS Statistics")) {
+                add_window<EcsStatsWindow>(true);
+                something_selected = true;
+            }
+
             end_window_here();
         }
 
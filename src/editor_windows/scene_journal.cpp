@@ -0,0 +1,518 @@
+#include "editor_windows/scene_journal.hpp"
+#include "ecs.hpp"
+#include "engine.hpp"
+#include "logging.hpp"
+#include "systems/notifications.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+
+
+namespace mgm {
+    namespace {
+        // Journals smaller than this are never worth rewriting the scene for, however small the scene is
+        constexpr size_t min_journal_bytes_to_compact = 1024 * 1024;
+
+        // 64 bit FNV-1a, which (unlike std::hash) gives the same hash for the same file on every platform and build
+        uint64_t hash_contents(const void* data, const size_t size) {
+            const auto bytes = static_cast<const uint8_t*>(data);
+            uint64_t res = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < size; ++i) {
+                res ^= bytes[i];
+                res *= 0x100000001b3ull;
+            }
+            return res;
+        }
+
+        // Paths are written as the indices joined by slashes ("0/3/1", or "" for the root)
+        JObject path_to_json(const SceneJournal::NodePath& path) {
+            std::string res{};
+            for (const auto i : path) {
+                if (!res.empty())
+                    res += '/';
+                res += std::to_string(i);
+            }
+            return JObject{"\"" + res + "\""};
+        }
+
+        SceneJournal::NodePath path_from_json(const JObject& json) {
+            const std::string text = json;
+            SceneJournal::NodePath res{};
+            size_t pos = 0;
+            while (pos < text.size()) {
+                auto end = text.find('/', pos);
+                if (end == std::string::npos)
+                    end = text.size();
+                res.emplace_back(static_cast<uint32_t>(std::stoul(text.substr(pos, end - pos))));
+                pos = end + 1;
+            }
+            return res;
+        }
+
+        JObject make_record(const std::string& op, const SceneJournal::NodePath& path) {
+            JObject res{};
+            res["op"] = op;
+            res["path"] = path_to_json(path);
+            return res;
+        }
+
+        // Every record is its length on a line of its own, followed by its Json and a new line, so a record cut off by a
+        // crash in the middle of writing it can be told apart from a whole one
+        std::string encode_records(const std::vector<JObject>& records) {
+            std::string res{};
+            for (const auto& record : records) {
+                const std::string text = record;
+                res += std::to_string(text.size());
+                res += '\n';
+                res += text;
+                res += '\n';
+            }
+            return res;
+        }
+
+        std::vector<JObject> decode_records(const std::string& text) {
+            std::vector<JObject> res{};
+            size_t pos = 0;
+            while (pos < text.size()) {
+                const auto line_end = text.find('\n', pos);
+                if (line_end == std::string::npos)
+                    break;
+
+                size_t size = 0;
+                try {
+                    size = std::stoull(text.substr(pos, line_end - pos));
+                }
+                catch (const std::exception&) {
+                    break;
+                }
+                if (text.size() - line_end - 1 < size)
+                    break;
+
+                res.emplace_back(text.substr(line_end + 1, size));
+                pos = line_end + 1 + size + 1;
+            }
+            return res;
+        }
+
+        JObject& mirror_node(JObject& scene, const SceneJournal::NodePath& path, const size_t depth) {
+            JObject* node = &scene;
+            for (size_t d = 0; d < depth; ++d) {
+                auto& children = (*node)["children"].array();
+                if (path[d] >= children.size())
+                    throw std::runtime_error("Journal record refers to a node the scene doesn't have");
+                node = &children[path[d]];
+            }
+            return *node;
+        }
+
+        // Apply a record to a scene loaded into the ecs, the same way SceneJournal::apply_to_mirror applies it to the Json
+        void apply_to_scene(EntityComponentSystem& ecs, const MGMecs<>::Entity root, const JObject& record) {
+            const std::string op = record["op"];
+            const auto path = path_from_json(record["path"]);
+            if (op != "components" && op != "rename" && path.empty())
+                throw std::runtime_error("Journal record changes the root of the scene");
+
+            const auto resolve = [&](const SceneJournal::NodePath& p) {
+                const auto res = SceneJournal::resolve(ecs.ecs, root, p);
+                if (res == MGMecs<>::null)
+                    throw std::runtime_error("Journal record refers to a node the scene doesn't have");
+                return res;
+            };
+            const SceneJournal::NodePath parent_path{path.begin(), path.end() - (path.empty() ? 0 : 1)};
+
+            if (op == "create") {
+                const auto parent = resolve(parent_path);
+                const auto e = ecs.ecs.create();
+                ecs.ecs.emplace<HierarchyNode>(e, parent, std::string(record["name"])).reparent(parent, path.back());
+            }
+            else if (op == "destroy")
+                ecs.ecs.destroy(resolve(path));
+            else if (op == "move") {
+                auto& node = ecs.ecs.get<HierarchyNode>(resolve(path_from_json(record["from"])));
+                node.reparent(MGMecs<>::null);
+                node.reparent(resolve(parent_path), path.back());
+            }
+            else if (op == "rename")
+                ecs.ecs.get<HierarchyNode>(resolve(path)).rename(record["name"]);
+            else if (op == "components") {
+                // The record holds all of the node's components, so the ones it doesn't have were removed
+                const auto e = resolve(path);
+                const auto& components = record["components"];
+                for (const auto& [id, type] : ecs.all_serialized_types())
+                    if (!components.has(id) && type.remove_component_from_entity)
+                        type.remove_component_from_entity(e);
+                ecs.deserialize_entity_components(e, components);
+            }
+            else
+                throw std::runtime_error("Unknown journal record \"" + op + "\"");
+        }
+
+        // Put the scene back the way its file has it, undoing the records which were applied to it
+        void reload_scene(EntityComponentSystem& ecs, const MGMecs<>::Entity root, const Path& path) {
+            const auto children = ecs.ecs.get<HierarchyNode>(root).children();
+            ecs.ecs.destroy(children.begin(), children.end());
+            for (const auto& [id, type] : ecs.all_serialized_types())
+                if (type.remove_component_from_entity)
+                    type.remove_component_from_entity(root);
+            ecs.load_scene(root, path);
+        }
+    } // namespace
+
+
+    SceneJournal::SceneJournal(const Path& scene_file_path, const MGMecs<>::Entity scene_root)
+        : scene_path{scene_file_path},
+          journal_path{scene_file_path.data + ".journal"},
+          root{scene_root} {
+        MagmaEngine engine{};
+        auto& file_io = engine.file_io();
+
+        uint64_t scene_hash = 0;
+        if (file_io.exists(scene_path)) {
+            const auto file = file_io.map_file(scene_path);
+            scene_hash = hash_contents(file.data(), file.size());
+            scene_bytes = file.size();
+        }
+
+        std::vector<JObject> records{};
+        std::string journal_text{};
+        if (file_io.exists(journal_path)) {
+            journal_text = file_io.read_text(journal_path);
+            records = decode_records(journal_text);
+            journal_bytes = journal_text.size();
+        }
+
+        auto journal_applies = !records.empty() && records.front().has("scene_hash") && std::string(records.front()["scene_hash"]) == std::to_string(scene_hash);
+        if (journal_applies) {
+            records.erase(records.begin());
+            records_since_compaction = records.size();
+
+            try {
+                for (const auto& record : records) apply_to_scene(engine.ecs(), root, record);
+                if (!records.empty())
+                    engine.notifications().push("Recovered " + std::to_string(records.size()) + " unsaved edits to scene: \"" + scene_path.as_platform_independent().data + "\"");
+            }
+            catch (const std::exception& e) {
+                // The scene is put back the way its file has it, and the journal is kept aside for whoever wants to recover
+                // the edits by hand, rather than compacting half of it into the scene file
+                const Path failed_path{journal_path.data + ".failed"};
+                Logging{"SceneJournal"}.error("Failed to recover edits to scene \"", scene_path.platform_path(), "\": ", e.what(), ", the journal was kept as \"", failed_path.platform_path(), "\"");
+                file_io.write_text(failed_path, journal_text);
+                reload_scene(engine.ecs(), root, scene_path);
+
+                journal_applies = false;
+                records_since_compaction = 0;
+                records.clear();
+            }
+        }
+        else
+            records.clear();
+
+        scene_is_json = engine.ecs().scene_format(scene_path) == EntityComponentSystem::SceneFormat::JSON;
+        open_journals[scene_path] = this;
+
+        worker = std::thread{&SceneJournal::run, this};
+        push_job([this, records = std::move(records), journal_applies, scene_hash] {
+            auto& worker_file_io = MagmaEngine{}.file_io();
+            if (!journal_applies)
+                restart_journal(scene_hash);
+
+            // Binary scenes are compacted from the ecs, so they don't need the mirror
+            if (!scene_is_json)
+                return;
+            if (!worker_file_io.exists(scene_path)) {
+                mirror_lost = true;
+                return;
+            }
+
+            mirror = JObject{worker_file_io.read_text(scene_path)};
+            try {
+                for (const auto& record : records) apply_to_mirror(record);
+                mirror_valid = true;
+            }
+            catch (const std::exception&) {
+                mirror_lost = true;
+            }
+        });
+    }
+
+    SceneJournal* SceneJournal::of(const Path& scene_file_path) {
+        const auto it = open_journals.find(scene_file_path);
+        return it != open_journals.end() ? it->second : nullptr;
+    }
+
+    std::optional<SceneJournal::NodePath> SceneJournal::path_of(const MGMecs<>& ecs, const MGMecs<>::Entity scene_root, MGMecs<>::Entity entity) {
+        NodePath res{};
+        while (entity != scene_root) {
+            const auto node = ecs.try_get<HierarchyNode>(entity);
+            if (node == nullptr || node->parent == MGMecs<>::null)
+                return std::nullopt;
+            res.emplace_back(static_cast<uint32_t>(node->index_in_parent));
+            entity = node->parent;
+        }
+        std::reverse(res.begin(), res.end());
+        return res;
+    }
+
+    MGMecs<>::Entity SceneJournal::resolve(const MGMecs<>& ecs, const MGMecs<>::Entity scene_root, const NodePath& path) {
+        auto entity = scene_root;
+        for (const auto i : path) {
+            const auto node = ecs.try_get<HierarchyNode>(entity);
+            if (node == nullptr || i >= node->num_children())
+                return MGMecs<>::null;
+            entity = node->child_entities[i];
+        }
+        return entity;
+    }
+
+    void SceneJournal::record_create(const MGMecs<>::Entity entity) {
+        const auto& ecs = MagmaEngine{}.ecs().ecs;
+        const auto path = path_of(ecs, root, entity);
+        if (!path)
+            return;
+
+        auto record = make_record("create", *path);
+        record["name"] = ecs.get<HierarchyNode>(entity).name;
+        pending.emplace_back(std::move(record));
+    }
+
+    void SceneJournal::record_destroy(const MGMecs<>::Entity entity) {
+        // The components of destroyed nodes which were edited are skipped by the flush, since they have no path anymore
+        if (const auto path = path_of(MagmaEngine{}.ecs().ecs, root, entity))
+            pending.emplace_back(make_record("destroy", *path));
+    }
+
+    void SceneJournal::record_move(const NodePath& from, const MGMecs<>::Entity entity) {
+        const auto path = path_of(MagmaEngine{}.ecs().ecs, root, entity);
+        if (!path)
+            return;
+
+        auto record = make_record("move", *path);
+        record["from"] = path_to_json(from);
+        pending.emplace_back(std::move(record));
+    }
+
+    void SceneJournal::record_rename(const MGMecs<>::Entity entity) {
+        const auto& ecs = MagmaEngine{}.ecs().ecs;
+        const auto path = path_of(ecs, root, entity);
+        if (!path)
+            return;
+
+        auto record = make_record("rename", *path);
+        record["name"] = ecs.get<HierarchyNode>(entity).name;
+        pending.emplace_back(std::move(record));
+    }
+
+    void SceneJournal::mark_edited(const MGMecs<>::Entity entity) {
+        edited.emplace_back(entity);
+    }
+
+    void SceneJournal::hand_over() {
+        auto& ecs = MagmaEngine{}.ecs();
+
+        // Recorded after the structural edits, with the paths the nodes have after all of them
+        std::sort(edited.begin(), edited.end());
+        edited.erase(std::unique(edited.begin(), edited.end()), edited.end());
+        for (const auto e : edited) {
+            const auto path = path_of(ecs.ecs, root, e);
+            if (!path)
+                continue;
+
+            auto record = make_record("components", *path);
+            record["components"] = ecs.serialize_entity_components(e);
+            pending.emplace_back(std::move(record));
+        }
+        edited.clear();
+
+        if (pending.empty())
+            return;
+
+        records_since_compaction += pending.size();
+        push_job([this, records = std::move(pending)] {
+            const auto text = encode_records(records);
+            MagmaEngine{}.file_io().append_text(journal_path, text);
+            journal_bytes += text.size();
+
+            if (!mirror_valid)
+                return;
+            try {
+                for (const auto& record : records) apply_to_mirror(record);
+            }
+            catch (const std::exception&) {
+                mirror_valid = false;
+                mirror_lost = true;
+            }
+        });
+        pending.clear();
+    }
+
+    void SceneJournal::flush() {
+        hand_over();
+        if (mirror_lost || journal_bytes >= std::max(min_journal_bytes_to_compact, scene_bytes / 4))
+            compact();
+    }
+
+    void SceneJournal::compact() {
+        hand_over();
+        if (records_since_compaction == 0 && !mirror_lost)
+            return;
+
+        auto& ecs = MagmaEngine{}.ecs();
+        if (ecs.ecs.try_get<HierarchyNode>(root) == nullptr)
+            return;
+
+        if (!scene_is_json)
+            push_job([this, data = ecs.serialize_scene_binary(root)] { compact_from_binary(data); });
+        else if (mirror_lost) {
+            // The mirror is rebuilt from the ecs, which costs a full serialization on this thread, but only once
+            mirror_lost = false;
+            push_job([this, scene = ecs.serialize_scene(root)]() mutable {
+                mirror = std::move(scene);
+                mirror_valid = true;
+                compact_from_mirror();
+            });
+        }
+        else
+            push_job([this] { compact_from_mirror(); });
+
+        records_since_compaction = 0;
+    }
+
+    void SceneJournal::compact_from_mirror() {
+        if (!mirror_valid) {
+            mirror_lost = true;
+            return;
+        }
+
+        const std::string text = mirror;
+        MagmaEngine{}.file_io().write_text(scene_path, text);
+        scene_bytes = text.size();
+        restart_journal(hash_contents(text.data(), text.size()));
+    }
+
+    void SceneJournal::compact_from_binary(const std::vector<uint8_t>& data) {
+        MagmaEngine{}.file_io().write_binary(scene_path, data);
+        scene_bytes = data.size();
+        restart_journal(hash_contents(data.data(), data.size()));
+    }
+
+    void SceneJournal::convert(const EntityComponentSystem::SceneFormat format) {
+        // The converted file has every edit made so far in it, so none of the records made before have to be written
+        pending.clear();
+        edited.clear();
+        records_since_compaction = 0;
+
+        auto& ecs = MagmaEngine{}.ecs();
+        scene_is_json = format == EntityComponentSystem::SceneFormat::JSON;
+        mirror_lost = false;
+        if (scene_is_json) {
+            push_job([this, scene = ecs.serialize_scene(root)]() mutable {
+                mirror = std::move(scene);
+                mirror_valid = true;
+                compact_from_mirror();
+            });
+        }
+        else {
+            push_job([this, data = ecs.serialize_scene_binary(root)] {
+                mirror = JObject{};
+                mirror_valid = false;
+                compact_from_binary(data);
+            });
+        }
+    }
+
+    void SceneJournal::restart_journal(const uint64_t scene_hash) {
+        JObject header{};
+        header["scene_hash"] = JObject{"\"" + std::to_string(scene_hash) + "\""};
+
+        const auto text = encode_records({header});
+        MagmaEngine{}.file_io().write_text(journal_path, text);
+        journal_bytes = text.size();
+    }
+
+    void SceneJournal::apply_to_mirror(const JObject& record) {
+        const std::string op = record["op"];
+        const auto path = path_from_json(record["path"]);
+        if (op != "components" && op != "rename" && path.empty())
+            throw std::runtime_error("Journal record changes the root of the scene");
+
+        const auto insert = [&](JObject node) {
+            auto& siblings = mirror_node(mirror, path, path.size() - 1)["children"].array();
+            const auto index = std::min(static_cast<size_t>(path.back()), siblings.size());
+            siblings.insert(siblings.begin() + static_cast<std::ptrdiff_t>(index), std::move(node));
+        };
+        const auto extract = [&](const NodePath& p) {
+            auto& siblings = mirror_node(mirror, p, p.size() - 1)["children"].array();
+            if (p.back() >= siblings.size())
+                throw std::runtime_error("Journal record refers to a node the scene doesn't have");
+
+            auto res = std::move(siblings[p.back()]);
+            siblings.erase(siblings.begin() + static_cast<std::ptrdiff_t>(p.back()));
+            return res;
+        };
+
+        if (op == "create") {
+            JObject node{};
+            node["name"] = record["name"];
+            node["components"] = JObject{};
+            node["children"].array();
+            insert(std::move(node));
+        }
+        else if (op == "destroy")
+            extract(path);
+        else if (op == "move") {
+            const auto from = path_from_json(record["from"]);
+            if (from.empty())
+                throw std::runtime_error("Journal record changes the root of the scene");
+            insert(extract(from));
+        }
+        else if (op == "rename")
+            mirror_node(mirror, path, path.size())["name"] = record["name"];
+        else if (op == "components")
+            mirror_node(mirror, path, path.size())["components"] = record["components"];
+        else
+            throw std::runtime_error("Unknown journal record \"" + op + "\"");
+    }
+
+    void SceneJournal::run() {
+        std::unique_lock lock{mutex};
+        while (true) {
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+
+            auto job = std::move(jobs.front());
+            jobs.pop_front();
+            lock.unlock();
+
+            try {
+                job();
+            }
+            catch (const std::exception& e) {
+                Logging{"SceneJournal"}.error("Failed to autosave scene \"", scene_path.platform_path(), "\": ", e.what());
+            }
+
+            lock.lock();
+        }
+    }
+
+    void SceneJournal::push_job(std::function<void()> job) {
+        {
+            std::unique_lock lock{mutex};
+            jobs.emplace_back(std::move(job));
+        }
+        cv.notify_all();
+    }
+
+    SceneJournal::~SceneJournal() {
+        if (const auto it = open_journals.find(scene_path); it != open_journals.end() && it->second == this)
+            open_journals.erase(it);
+        {
+            std::unique_lock lock{mutex};
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+} // namespace mgm
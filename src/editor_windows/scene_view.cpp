@@ -18,6 +18,8 @@
 namespace mgm {
     static inline thread_local Path current_scene_path{};
     constexpr auto save_interval = 5.0f;
+    // How often the journal of a scene is folded into the scene file, so the file doesn't stay behind until the viewport closes
+    constexpr auto compaction_interval = 60.0f;
     struct HierarchyView::Data {
         MGMecs<>::Entity selected{};
         JObject selected_serialized_data{};
@@ -30,15 +32,12 @@ namespace mgm {
     void SceneViewport::do_save() {
         MagmaEngine engine{};
 
-        if (engine.ecs().ecs.try_get<HierarchyNode>(current_scene_root) == nullptr)
+        if (current_journal == nullptr || engine.ecs().ecs.try_get<HierarchyNode>(current_scene_root) == nullptr)
             return;
 
-        JObject scene_data{};
-        scene_data["name"] = "Root";
-        scene_data["components"] = {};
-        scene_data["children"] = engine.ecs().serialize_node(current_scene_root);
-        engine.file_io().write_text(current_scene_path, scene_data);
-        engine.notifications().push("Saved scene: \"" + current_scene_path.as_platform_independent().data + "\"");
+        // Only the edits made since the last save are written, appended to the scene's journal on the journal's own thread
+        current_journal->flush();
+        engine.notifications().push("Autosaved edits to the journal of scene: \"" + current_scene_path.as_platform_independent().data + "\"");
     }
 
     SceneViewport::SceneViewport(const Path& scene_path) {
@@ -48,8 +47,10 @@ namespace mgm {
 
         this_viewport_scene_root = engine.ecs().load_scene_into_new_root(scene_path);
         this_viewport_scene_path = scene_path;
+        journal = std::make_unique<SceneJournal>(scene_path, this_viewport_scene_root);
         current_scene_root = this_viewport_scene_root;
         current_scene_path = this_viewport_scene_path;
+        current_journal = journal.get();
     }
 
     void SceneViewport::draw_contents() {
@@ -94,6 +95,7 @@ namespace mgm {
 
                 current_scene_root = this_viewport_scene_root;
                 current_scene_path = this_viewport_scene_path;
+                current_journal = journal.get();
                 time_since_last_edit = save_interval;
             }
         }
@@ -103,11 +105,24 @@ namespace mgm {
             if (time_since_last_edit >= save_interval)
                 do_save();
         }
+
+        // Only when the worker does the serializing, binary scenes are compacted once their journal grew large and on closing
+        time_since_last_compaction += engine.delta_time();
+        if (time_since_last_compaction >= compaction_interval) {
+            time_since_last_compaction = 0.0f;
+            if (journal->compacts_off_thread())
+                journal->compact();
+        }
     }
 
     SceneViewport::~SceneViewport() {
-        if (time_since_last_edit < save_interval)
-            do_save();
+        // Everything journaled is folded into the scene file when its viewport closes
+        if (journal != nullptr) {
+            journal->compact();
+            if (current_journal == journal.get())
+                current_journal = nullptr;
+            journal.reset();
+        }
         if (viewport_texture != MgmGPU::INVALID_TEXTURE) {
             auto& renderer = MagmaEngine{}.renderer();
             std::unique_lock lock{renderer.mutex};
@@ -163,7 +178,9 @@ namespace mgm {
         if (ImGui::Button("+")) {
             const auto new_parent = data->selected == MGMecs<>::null ? SceneViewport::current_scene_root : data->selected;
             const auto name = name_entity(new_parent, "Node");
-            ecs.emplace<HierarchyNode>(ecs.create(), new_parent).name = name;
+            const auto new_entity = ecs.create();
+            ecs.emplace<HierarchyNode>(new_entity, new_parent, name);
+            SceneViewport::current_journal->record_create(new_entity);
             SceneViewport::time_since_last_edit = 0.0f;
         }
 
@@ -174,6 +191,7 @@ namespace mgm {
 
         if (ImGui::Button((const char*)(u8"\u00D7"))) {
             if (data->selected != MGMecs<>::null) {
+                SceneViewport::current_journal->record_destroy(data->selected);
                 ecs.destroy(data->selected);
                 data->selected = MGMecs<>::null;
                 SceneViewport::time_since_last_edit = 0.0f;
@@ -247,25 +265,32 @@ namespace mgm {
                     if (payload = ImGui::AcceptDragDropPayload("HIERARCHY_NODE"); payload) {
                         const auto entity = *static_cast<const MGMecs<>::Entity*>(payload->Data);
                         auto& entity_node = ecs.get<HierarchyNode>(entity);
+                        const auto moved_from = SceneJournal::path_of(ecs, SceneViewport::current_scene_root, entity);
+                        const auto old_name = entity_node.name;
                         entity_node.reparent(MGMecs<>::null);
 
                         if (cursor_pos.y < top) {
                             auto& parent_node = ecs.get<HierarchyNode>(node.parent);
                             const auto index = parent_node.find_child_index(parent);
-                            entity_node.name = name_entity(node.parent, entity_node.name);
+                            entity_node.rename(name_entity(node.parent, entity_node.name));
                             entity_node.reparent(node.parent, index);
                         }
                         else if (cursor_pos.y > bottom) {
                             auto& parent_node = ecs.get<HierarchyNode>(node.parent);
                             const auto index = parent_node.find_child_index(parent) + 1;
-                            entity_node.name = name_entity(node.parent, entity_node.name);
+                            entity_node.rename(name_entity(node.parent, entity_node.name));
                             entity_node.reparent(node.parent, index);
                         }
                         else {
-                            entity_node.name = name_entity(parent, entity_node.name);
+                            entity_node.rename(name_entity(parent, entity_node.name));
                             entity_node.reparent(parent);
                         }
 
+                        if (moved_from) {
+                            SceneViewport::current_journal->record_move(*moved_from, entity);
+                            if (entity_node.name != old_name)
+                                SceneViewport::current_journal->record_rename(entity);
+                        }
                         SceneViewport::time_since_last_edit = 0.0f;
                     }
                     ImGui::EndDragDropTarget();
@@ -273,11 +298,11 @@ namespace mgm {
             };
 
             const auto do_down_arrow_not_open = [&]() {
-                if (node.next != MGMecs<>::null)
-                    data->selected = node.next;
+                if (const auto next = node.next_sibling(); next != MGMecs<>::null)
+                    data->selected = next;
                 else if (node.parent != MGMecs<>::null) {
                     const auto& parent_node = ecs.get<HierarchyNode>(node.parent);
-                    data->selected = parent_node.next;
+                    data->selected = parent_node.next_sibling();
                 }
                 else
                     data->selected = MGMecs<>::null;
@@ -286,7 +311,7 @@ namespace mgm {
             const auto do_up_arrow = [&]() {
                 if (ImGui::IsKeyPressed(ImGuiKey_UpArrow) && data->selected == parent && ImGui::IsWindowFocused()) {
                     if (node.parent != MGMecs<>::null) {
-                        if (node.prev == MGMecs<>::null)
+                        if (node.prev_sibling() == MGMecs<>::null)
                             data->selected = node.parent == SceneViewport::current_scene_root ? MGMecs<>::null : node.parent;
                         else
                             data->selected = data->last_drawn_entity;
@@ -303,7 +328,7 @@ namespace mgm {
                     data->selection_came_from_navigating_with_down_arrow = false;
                 else if (data->selected == parent && ImGui::IsKeyPressed(ImGuiKey_DownArrow) && ImGui::IsWindowFocused()) {
                     if (node_open)
-                        data->selected = node.child;
+                        data->selected = node.first_child();
                     else
                         do_down_arrow_not_open();
                     data->selection_came_from_navigating_with_down_arrow = true;
@@ -315,7 +340,7 @@ namespace mgm {
                 do_drag_drop();
 
                 if (node_open) {
-                    for (const auto entity : node) draw_parent_and_children(entity);
+                    for (const auto entity : node.children()) draw_parent_and_children(entity);
 
                     ImGui::TreePop();
                 }
@@ -344,7 +369,7 @@ namespace mgm {
         if (ImGui::IsWindowFocused()) {
             if (data->selected == MGMecs<>::null) {
                 if (ImGui::IsKeyPressed(ImGuiKey_DownArrow))
-                    data->selected = ecs.get<HierarchyNode>(SceneViewport::current_scene_root).child;
+                    data->selected = ecs.get<HierarchyNode>(SceneViewport::current_scene_root).first_child();
                 if (ImGui::IsKeyPressed(ImGuiKey_UpArrow))
                     data->selected = data->last_drawn_entity;
             }
@@ -455,8 +480,10 @@ namespace mgm {
             }
         }
 
-        if (any_edited)
+        if (any_edited) {
+            SceneViewport::current_journal->mark_edited(data->selected);
             SceneViewport::time_since_last_edit = 0.0f;
+        }
 
         ImGui::Separator();
 
@@ -478,6 +505,7 @@ namespace mgm {
         if (ImGui::Button("Add Component +", {ImGui::GetContentRegionAvail().x, 0.0f})) {
             engine.ecs().add_component_of_type_to_entity(type_ids[static_cast<size_t>(current_type_n)], data->selected);
             data->selected_serialized_data = engine.ecs().serialize_entity_components(data->selected);
+            SceneViewport::current_journal->mark_edited(data->selected);
             SceneViewport::time_since_last_edit = 0.0f;
         }
         if (!current_type_n)
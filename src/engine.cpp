@@ -225,6 +225,16 @@ namespace mgm {
 #else
             for (const auto& [id, sys] : systems().systems) sys->update(delta);
 #endif
+            // Structural changes systems deferred during the frame are applied once all of them finished updating,
+            // and the frame's changes get a tick of their own, then a bit of the pending hierarchy reordering is done,
+            // and the render thread gets a snapshot of the finished frame
+            {
+                const auto ecs_lock = ecs().ecs_lock();
+                ecs().ecs.flush_commands();
+                ecs().ecs.advance_tick();
+                ecs().step_hierarchy_sort(ecs().hierarchy_sort_budget);
+                renderer().extract_snapshot();
+            }
             lock.unlock();
 
             ImGui::EndFrame();
@@ -6,42 +6,33 @@
 #include "mgmgpu.hpp"
 #include "systems/resources.hpp"
 #include "tools/mgmecs.hpp"
+#include <utility>
 
 
 namespace mgm {
-    thread_local mat4f current_cam_transform{};
-
-    void Renderer::gen_draw_calls(EntityComponentSystem& ecs, std::vector<MgmGPU::DrawCall>& draw_calls, MGMecs<>::Entity entity, const Transform& parent_transform) {
-        for (const auto& e : ecs.ecs.get<HierarchyNode>(entity)) {
-            ecs.ecs.wait_and_lock(e);
-
-            const auto transform = ecs.ecs.try_get<Transform>(e);
-            if (transform == nullptr) {
-                ecs.ecs.unlock(e);
+    void Renderer::extract(EntityComponentSystem& ecs, RenderSnapshot& snapshot, MGMecs<>::Entity entity, const Transform& parent_transform) {
+        // Read-only access, so extracting does not mark every component as changed
+        // Only the update thread changes the world, and it's the one extracting, so no entity needs to be locked
+        const auto& world = std::as_const(ecs.ecs);
+
+        for (const auto& e : world.get<HierarchyNode>(entity)) {
+            const auto transform = world.try_get<Transform>(e);
+            if (transform == nullptr)
                 continue;
-            }
 
-            const auto mesh = ecs.ecs.try_get<ResourceReference<Mesh>>(e);
-            if (mesh == nullptr || !mesh->valid() || !mesh->get().shader.valid()) {
-                ecs.ecs.unlock(e);
+            const auto mesh = world.try_get<ResourceReference<Mesh>>(e);
+            if (mesh == nullptr || !mesh->valid() || !mesh->get().shader.valid())
                 continue;
-            }
 
             const auto local_transform = parent_transform * *transform;
 
-            draw_calls.emplace_back(MgmGPU::DrawCall{
-                .type = MgmGPU::DrawCall::Type::DRAW,
+            snapshot.items.emplace_back(RenderSnapshot::Item{
                 .shader = mesh->get().shader.get().created_shader,
                 .buffers_object = mesh->get().buffers_object,
-                .textures = {}, // TODO: Add textures in meshes
-                .parameters = {
-                             {"transform", local_transform.as_matrix()}, {"camera", current_cam_transform}, {"proj", projection}
-                }
+                .transform = local_transform.as_matrix(),
             });
 
-            gen_draw_calls(ecs, draw_calls, e, local_transform);
-
-            ecs.ecs.unlock(e);
+            extract(ecs, snapshot, e, local_transform);
         }
     }
 
@@ -55,19 +46,11 @@ namespace mgm {
         projection = mat4f::gen_perspective_projection(90.0f, 9.0f / 16.0f, 0.1f, 1000.0f);
     }
 
-    void Renderer::graphics_update() {
+    void Renderer::extract_snapshot() {
         auto& ecs = MagmaEngine{}.ecs();
 
-        std::vector<MgmGPU::DrawCall> draw_calls{};
-
-        mutex.lock();
-        const auto use_settings = settings;
-        mutex.unlock();
-
-        if (use_settings.canvas == MgmGPU::INVALID_TEXTURE || !MagmaEngine{}.graphics().is_valid(use_settings.canvas))
-            return;
-
-        draw_calls.emplace_back(MgmGPU::DrawCall{.type = MgmGPU::DrawCall::Type::CLEAR});
+        auto& snapshot = snapshots.back();
+        snapshot.items.clear();
 
 #if defined(ENABLE_EDITOR)
         MGMecs<>::Entity scene{};
@@ -79,11 +62,39 @@ namespace mgm {
         const auto scene = ecs.root;
 #endif
 
-        if (scene != MGMecs<>::null) {
-            ecs.ecs.wait_and_lock(scene);
-            current_cam_transform = camera.as_matrix();
-            gen_draw_calls(ecs, draw_calls, scene);
-            ecs.ecs.unlock(scene);
+        if (scene != MGMecs<>::null && ecs.ecs.valid(scene))
+            extract(ecs, snapshot, scene);
+
+        snapshots.publish();
+    }
+
+    void Renderer::graphics_update() {
+        std::vector<MgmGPU::DrawCall> draw_calls{};
+
+        mutex.lock();
+        const auto use_settings = settings;
+        const auto cam_transform = camera.as_matrix();
+        const auto proj = projection;
+        mutex.unlock();
+
+        if (use_settings.canvas == MgmGPU::INVALID_TEXTURE || !MagmaEngine{}.graphics().is_valid(use_settings.canvas))
+            return;
+
+        draw_calls.emplace_back(MgmGPU::DrawCall{.type = MgmGPU::DrawCall::Type::CLEAR});
+
+        // Drawn from the newest snapshot, so the render thread never touches the ECS
+        const auto& snapshot = snapshots.front();
+        draw_calls.reserve(snapshot.items.size() + 1);
+        for (const auto& item : snapshot.items) {
+            draw_calls.emplace_back(MgmGPU::DrawCall{
+                .type = MgmGPU::DrawCall::Type::DRAW,
+                .shader = item.shader,
+                .buffers_object = item.buffers_object,
+                .textures = {}, // TODO: Add textures in meshes
+                .parameters = {
+                             {"transform", item.transform}, {"camera", cam_transform}, {"proj", proj}
+                }
+            });
         }
 
         MagmaEngine{}.graphics().draw(draw_calls, use_settings);